@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "matrix.h"
+
+/*
+ * Benchmark harness for the operations in matrix.h. Every operation is
+ * run over each combination of order and thread count, warmed up and then
+ * repeated, and one CSV row per combination reports latency percentiles
+ * with the throughput they imply.
+ */
+
+#define MAX_SWEEP 32
+#define POW_EXPONENT 5
+
+typedef uint32_t* (*bench_fn)(void);
+
+struct bench_op {
+    const char* name;
+    bench_fn run;
+    double bytes;   /* bytes read and written per element */
+    double ops;     /* operations per element */
+    double cubic;   /* operations per order^3 */
+};
+
+static ssize_t g_order = 0;
+static uint32_t* g_a = NULL;
+static uint32_t* g_b = NULL;
+static struct matrix_index* g_index = NULL;
+static char g_path[] = "/tmp/matrix-bench-XXXXXX";
+
+static int g_stdout = -1;
+static int g_null = -1;
+
+/* the result of reductions is kept here so they are not optimised out */
+static volatile uint32_t g_sink = 0;
+
+////////////////////////////////
+///        OPERATIONS        ///
+////////////////////////////////
+
+static uint32_t* run_new(void)        { return new_matrix(); }
+static uint32_t* run_identity(void)   { return identity_matrix(); }
+static uint32_t* run_random(void)     { return random_matrix(42); }
+static uint32_t* run_uniform(void)    { return uniform_matrix(7); }
+static uint32_t* run_sequence(void)   { return sequence_matrix(3, 5); }
+static uint32_t* run_cloned(void)     { return cloned(g_a); }
+static uint32_t* run_reversed(void)   { return reversed(g_a); }
+static uint32_t* run_transposed(void) { return transposed(g_a); }
+static uint32_t* run_scalar_add(void) { return scalar_add(g_a, 3); }
+static uint32_t* run_scalar_mul(void) { return scalar_mul(g_a, 3); }
+static uint32_t* run_matrix_add(void) { return matrix_add(g_a, g_b); }
+static uint32_t* run_matrix_mul(void) { return matrix_mul(g_a, g_b); }
+static uint32_t* run_matrix_pow(void) { return matrix_pow(g_a, POW_EXPONENT); }
+
+static uint32_t* run_sum(void)        { g_sink = get_sum(g_a); return NULL; }
+static uint32_t* run_trace(void)      { g_sink = get_trace(g_a); return NULL; }
+static uint32_t* run_minimum(void)    { g_sink = get_minimum(g_a); return NULL; }
+static uint32_t* run_maximum(void)    { g_sink = get_maximum(g_a); return NULL; }
+static uint32_t* run_frequency(void)  { g_sink = get_frequency(g_a, 7); return NULL; }
+static uint32_t* run_stats(void)      { g_sink = get_stats(g_a, 7).sum; return NULL; }
+
+static uint32_t* run_index(void)      { release_index(index_matrix(g_a)); return NULL; }
+static uint32_t* run_indexed(void)    { g_sink = index_frequency(g_index, 7); return NULL; }
+
+static uint32_t* run_save(void)       { g_sink = save_matrix(g_a, g_path); return NULL; }
+static uint32_t* run_load(void)       { return load_matrix(g_path); }
+
+/* display output is sent to /dev/null while timed */
+
+static uint32_t* run_display(void) {
+
+    dup2(g_null, STDOUT_FILENO);
+    display(g_a);
+    fflush(stdout);
+    dup2(g_stdout, STDOUT_FILENO);
+
+    return NULL;
+}
+
+static uint32_t* run_display_row(void) {
+
+    dup2(g_null, STDOUT_FILENO);
+    display_row(g_a, g_order / 2);
+    fflush(stdout);
+    dup2(g_stdout, STDOUT_FILENO);
+
+    return NULL;
+}
+
+static uint32_t* run_display_column(void) {
+
+    dup2(g_null, STDOUT_FILENO);
+    display_column(g_a, g_order / 2);
+    fflush(stdout);
+    dup2(g_stdout, STDOUT_FILENO);
+
+    return NULL;
+}
+
+static uint32_t* run_display_element(void) {
+
+    dup2(g_null, STDOUT_FILENO);
+    display_element(g_a, g_order / 2, g_order / 2);
+    fflush(stdout);
+    dup2(g_stdout, STDOUT_FILENO);
+
+    return NULL;
+}
+
+/* square-and-multiply does bit length - 1 squarings and popcount - 1 products */
+#define POW_PRODUCTS (31 - __builtin_clz(POW_EXPONENT) + __builtin_popcount(POW_EXPONENT) - 1)
+
+static const struct bench_op OPERATIONS[] = {
+    { "new_matrix",      run_new,             4,  0, 0 },
+    { "identity_matrix", run_identity,        4,  0, 0 },
+    { "random_matrix",   run_random,          4,  1, 0 },
+    { "uniform_matrix",  run_uniform,         4,  0, 0 },
+    { "sequence_matrix", run_sequence,        4,  1, 0 },
+    { "cloned",          run_cloned,          8,  0, 0 },
+    { "reversed",        run_reversed,        8,  0, 0 },
+    { "transposed",      run_transposed,      8,  0, 0 },
+    { "scalar_add",      run_scalar_add,      8,  1, 0 },
+    { "scalar_mul",      run_scalar_mul,      8,  1, 0 },
+    { "matrix_add",      run_matrix_add,      12, 1, 0 },
+    { "matrix_mul",      run_matrix_mul,      12, 0, 2 },
+    { "matrix_pow",      run_matrix_pow,      12, 0, 2 * POW_PRODUCTS },
+    { "get_sum",         run_sum,             4,  1, 0 },
+    { "get_trace",       run_trace,           0,  0, 0 },
+    { "get_minimum",     run_minimum,         4,  1, 0 },
+    { "get_maximum",     run_maximum,         4,  1, 0 },
+    { "get_frequency",   run_frequency,       4,  1, 0 },
+    { "get_stats",       run_stats,           4,  4, 0 },
+    { "index_matrix",    run_index,           28, 3, 0 },
+    { "index_frequency", run_indexed,         0,  0, 0 },
+    { "display",         run_display,         4,  1, 0 },
+    { "display_row",     run_display_row,     0,  0, 0 },
+    { "display_column",  run_display_column,  0,  0, 0 },
+    { "display_element", run_display_element, 0,  0, 0 },
+    { "save_matrix",     run_save,            4,  0, 0 },
+    { "load_matrix",     run_load,            0,  0, 0 },
+};
+
+#define NOPERATIONS ((ssize_t) (sizeof(OPERATIONS) / sizeof(OPERATIONS[0])))
+
+////////////////////////////////
+///        MEASUREMENT       ///
+////////////////////////////////
+
+static double now(void) {
+
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+
+    const double x = *(const double*) a;
+    const double y = *(const double*) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Returns the nearest-rank percentile of sorted samples
+ */
+static double percentile(const double* samples, ssize_t count, double p) {
+
+    ssize_t rank = (ssize_t) (p / 100.0 * count + 0.999999);
+    rank = rank < 1 ? 1 : rank > count ? count : rank;
+
+    return samples[rank - 1];
+}
+
+/**
+ * Times one operation at the current settings and prints its CSV row
+ */
+static void bench_op(FILE* out, const struct bench_op* op, ssize_t nthreads,
+                     ssize_t warmup, ssize_t repeat) {
+
+    double* samples = malloc(repeat * sizeof(double));
+    if (!samples) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (ssize_t i = 0; i < warmup + repeat; i++) {
+        const double start = now();
+        uint32_t* result = op->run();
+        const double elapsed = now() - start;
+
+        release_matrix(result);
+        if (i >= warmup) {
+            samples[i - warmup] = elapsed;
+        }
+    }
+
+    qsort(samples, repeat, sizeof(double), compare_doubles);
+
+    const double n = (double) g_order;
+    const double elements = n * n;
+    const double median = percentile(samples, repeat, 50);
+
+    /* the trace and single row or column reads touch one element per row,
+       and a single element read touches just that element */
+    double bytes = op->bytes * elements;
+    double ops = op->ops * elements + op->cubic * n * n * n;
+    if (op->run == run_trace || op->run == run_display_row || op->run == run_display_column) {
+        bytes = 4 * n;
+        ops = n;
+    } else if (op->run == run_display_element) {
+        bytes = 4;
+        ops = 1;
+    }
+
+    fprintf(out, "%s,%zd,%zd,%zd,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f\n",
+            op->name, g_order, nthreads, repeat,
+            samples[0] * 1e3, median * 1e3,
+            percentile(samples, repeat, 90) * 1e3, percentile(samples, repeat, 99) * 1e3,
+            samples[repeat - 1] * 1e3,
+            bytes / median * 1e-9, ops / median * 1e-9);
+    fflush(out);
+
+    free(samples);
+}
+
+////////////////////////////////
+///          DRIVER          ///
+////////////////////////////////
+
+/**
+ * Parses a comma separated list of positive integers into values
+ */
+static ssize_t parse_list(const char* text, ssize_t* values) {
+
+    ssize_t count = 0;
+
+    while (*text != '\0' && count < MAX_SWEEP) {
+        char* end;
+        const long long value = strtoll(text, &end, 10);
+        if (end == text || value < 1) {
+            return 0;
+        }
+
+        values[count++] = value;
+        text = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return 0;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Parses a non-negative integer into value, returning false if text is not one
+ */
+static bool parse_count(const char* text, ssize_t* value) {
+
+    char* end;
+    const long long parsed = strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < 0) {
+        return false;
+    }
+
+    *value = parsed;
+    return true;
+}
+
+/**
+ * Returns whether name is one of the operations
+ */
+static bool known_operation(const char* name) {
+
+    for (ssize_t i = 0; i < NOPERATIONS; i++) {
+        if (strcmp(name, OPERATIONS[i].name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void usage(void) {
+
+    puts("Usage: bench [--orders <n,...>] [--threads <n,...>] [--warmup <count>]"
+         " [--repeat <count>] [--only <operation>] [--output <path>] [--pin]");
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+
+    static const struct option OPTIONS[] = {
+        { "orders", required_argument, NULL, 'o' },
+        { "threads", required_argument, NULL, 't' },
+        { "warmup", required_argument, NULL, 'w' },
+        { "repeat", required_argument, NULL, 'r' },
+        { "only", required_argument, NULL, 'n' },
+        { "output", required_argument, NULL, 'f' },
+        { "pin", no_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    ssize_t orders[MAX_SWEEP] = { 256, 1024 };
+    ssize_t threads[MAX_SWEEP] = { 1 };
+    ssize_t norders = 2, nthreads = 1;
+    ssize_t warmup = 1, repeat = 7;
+    const char* only = NULL;
+    FILE* out = stdout;
+    int option;
+
+    opterr = 0;
+    while ((option = getopt_long(argc, argv, "", OPTIONS, NULL)) != -1) {
+        switch (option) {
+            case 'o':
+                norders = parse_list(optarg, orders);
+                break;
+            case 't':
+                nthreads = parse_list(optarg, threads);
+                break;
+            case 'w':
+                if (!parse_count(optarg, &warmup)) {
+                    usage();
+                }
+                break;
+            case 'r':
+                if (!parse_count(optarg, &repeat)) {
+                    usage();
+                }
+                break;
+            case 'n':
+                only = optarg;
+                break;
+            case 'p':
+                set_pinning(true);
+                break;
+            case 'f':
+                out = fopen(optarg, "w");
+                if (out == NULL) {
+                    perror(optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (optind != argc || norders == 0 || nthreads == 0 || warmup < 0 || repeat < 1 ||
+        (only != NULL && !known_operation(only))) {
+        usage();
+    }
+
+    const int fd = mkstemp(g_path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+
+    g_stdout = dup(STDOUT_FILENO);
+    g_null = open("/dev/null", O_WRONLY);
+
+    fprintf(out, "operation,order,threads,repeat,min_ms,median_ms,p90_ms,p99_ms,max_ms,gb_per_s,gop_per_s\n");
+
+    for (ssize_t t = 0; t < nthreads; t++) {
+        set_nthreads(threads[t]);
+
+        for (ssize_t o = 0; o < norders; o++) {
+            g_order = orders[o];
+            set_dimensions(g_order);
+
+            g_a = random_matrix(1);
+            g_b = random_matrix(2);
+            g_index = index_matrix(g_a);
+            save_matrix(g_a, g_path);
+
+            for (ssize_t i = 0; i < NOPERATIONS; i++) {
+                if (only == NULL || strcmp(only, OPERATIONS[i].name) == 0) {
+                    bench_op(out, OPERATIONS + i, threads[t], warmup, repeat);
+                }
+            }
+
+            release_index(g_index);
+            release_matrix(g_a);
+            release_matrix(g_b);
+        }
+    }
+
+    unlink(g_path);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
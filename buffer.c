@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include "buffer.h"
+
+/*
+ * Recycling allocator for large buffers. Sizes are rounded up to whole
+ * pages, and released buffers are kept on a free list per size class so
+ * the next request of that size gets back memory that is already mapped
+ * and faulted in. Retained memory is capped, past which buffers are
+ * freed as usual. Buffers are not initialised.
+ *
+ * Small buffers come from the heap, 64-byte aligned. Buffers of at least
+ * BUFFER_HUGE are mapped on their own and aligned to BUFFER_HUGE so they
+ * can be backed by huge pages, either advised to the kernel's transparent
+ * huge pages or mapped from the hugetlb pool, falling back to the former
+ * when no huge pages are reserved.
+ */
+
+#define BUFFER_CLASSES 16
+#define BUFFER_HEADER 64
+
+/* sits just before the data, in a page of its own for mapped buffers */
+struct buffer_header {
+    size_t size;
+    size_t length;
+    bool file;
+    struct buffer_header* next;
+};
+
+struct buffer_class {
+    size_t size;
+    struct buffer_header* free;
+};
+
+static struct buffer_class g_classes[BUFFER_CLASSES];
+static size_t g_retained = 0;
+static size_t g_limit = BUFFER_DEFAULT_LIMIT;
+static enum buffer_pages g_pages = BUFFER_PAGES_DEFAULT;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Returns a buffer's memory to the system
+ */
+static void release_buffer(struct buffer_header* header) {
+
+    if (header->length == 0) {
+        free(header);
+        return;
+    }
+
+    /* the header lives in the page unmapped first */
+    char* data = (char*) header + BUFFER_HEADER;
+    const size_t length = header->length;
+
+    munmap(data - BUFFER_PAGE, BUFFER_PAGE);
+    munmap(data, length);
+}
+
+/**
+ * Maps a buffer aligned to BUFFER_HUGE, with a page for its header below
+ */
+static struct buffer_header* map_buffer(size_t size) {
+
+    const size_t length = (size + BUFFER_HUGE - 1) / BUFFER_HUGE * BUFFER_HUGE;
+    const size_t span = BUFFER_PAGE + BUFFER_HUGE + length;
+
+    char* raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    char* data = (char*) (((uintptr_t) raw + BUFFER_PAGE + BUFFER_HUGE - 1) & ~(uintptr_t) (BUFFER_HUGE - 1));
+    char* page = data - BUFFER_PAGE;
+
+    /* trim the reservation down to the header page and the aligned run */
+    if (page > raw) {
+        munmap(raw, page - raw);
+    }
+    if (raw + span > data + length) {
+        munmap(data + length, raw + span - (data + length));
+    }
+
+    bool huge = false;
+    if (g_pages == BUFFER_PAGES_HUGETLB) {
+        huge = mmap(data, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED;
+
+        /* a failed fixed mapping may have dropped the range, so map it again */
+        if (!huge && mmap(data, length, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+    }
+    if (!huge && g_pages != BUFFER_PAGES_DEFAULT) {
+        madvise(data, length, MADV_HUGEPAGE);
+    }
+
+    struct buffer_header* header = (struct buffer_header*) (data - BUFFER_HEADER);
+    header->length = length;
+
+    return header;
+}
+
+/**
+ * Sets how buffers of at least BUFFER_HUGE are backed from now on
+ */
+void buffer_set_pages(enum buffer_pages pages) {
+
+    g_pages = pages;
+}
+
+/**
+ * Sets how many bytes of released buffers are retained, freeing any
+ * retained buffers past the new limit
+ */
+void buffer_set_limit(size_t bytes) {
+
+    pthread_mutex_lock(&g_lock);
+
+    g_limit = bytes;
+
+    for (ssize_t i = 0; i < BUFFER_CLASSES && g_retained > g_limit; i++) {
+        struct buffer_class* class = g_classes + i;
+
+        while (class->free != NULL && g_retained > g_limit) {
+            struct buffer_header* header = class->free;
+            class->free = header->next;
+            g_retained -= header->size;
+            release_buffer(header);
+        }
+    }
+
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * Returns a buffer of at least the given size, reusing a released one
+ * of the same size class when available
+ */
+void* buffer_alloc(size_t bytes) {
+
+    const size_t size = (bytes + BUFFER_PAGE - 1) / BUFFER_PAGE * BUFFER_PAGE;
+
+    pthread_mutex_lock(&g_lock);
+
+    for (ssize_t i = 0; i < BUFFER_CLASSES; i++) {
+        struct buffer_class* class = g_classes + i;
+
+        if (class->size == size && class->free != NULL) {
+            struct buffer_header* header = class->free;
+            class->free = header->next;
+            g_retained -= size;
+
+            pthread_mutex_unlock(&g_lock);
+            return (char*) header + BUFFER_HEADER;
+        }
+    }
+
+    pthread_mutex_unlock(&g_lock);
+
+    struct buffer_header* header;
+
+    if (size >= BUFFER_HUGE) {
+        header = map_buffer(size);
+    } else {
+        header = aligned_alloc(64, BUFFER_HEADER + size);
+        if (!header) {
+            perror("aligned_alloc");
+            exit(1);
+        }
+        header->length = 0;
+    }
+
+    header->size = size;
+    header->file = false;
+
+    return (char*) header + BUFFER_HEADER;
+}
+
+/**
+ * Returns a buffer to its size class, or frees it if that would retain
+ * more than the limit or every class is in use by another size
+ */
+void buffer_free(void* buffer) {
+
+    if (buffer == NULL) {
+        return;
+    }
+
+    struct buffer_header* header = (struct buffer_header*) ((char*) buffer - BUFFER_HEADER);
+
+    pthread_mutex_lock(&g_lock);
+
+    /* file mappings are never recycled, which would keep the file open */
+    if (!header->file && g_retained + header->size <= g_limit) {
+        struct buffer_class* target = NULL;
+
+        /* prefer the class of this size, else any class with nothing retained */
+        for (ssize_t i = 0; i < BUFFER_CLASSES; i++) {
+            struct buffer_class* class = g_classes + i;
+
+            if (class->size == header->size) {
+                target = class;
+                break;
+            } else if (class->free == NULL && target == NULL) {
+                target = class;
+            }
+        }
+
+        if (target != NULL) {
+            target->size = header->size;
+            header->next = target->free;
+            target->free = header;
+            g_retained += header->size;
+
+            pthread_mutex_unlock(&g_lock);
+            return;
+        }
+    }
+
+    pthread_mutex_unlock(&g_lock);
+
+    release_buffer(header);
+}
+
+/**
+ * Maps bytes of data stored from offset BUFFER_PAGE in fd as a buffer. The
+ * mapping is private, so writes to the buffer copy pages instead of
+ * reaching the file, and the first page holds the buffer's header.
+ * Returns NULL if the file cannot be mapped.
+ */
+void* buffer_map_file(int fd, size_t bytes) {
+
+    const size_t length = (bytes + BUFFER_PAGE - 1) / BUFFER_PAGE * BUFFER_PAGE;
+
+    char* base = mmap(NULL, BUFFER_PAGE + length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    struct buffer_header* header = (struct buffer_header*) (base + BUFFER_PAGE - BUFFER_HEADER);
+    header->size = length;
+    header->length = length;
+    header->file = true;
+
+    return base + BUFFER_PAGE;
+}
+
+/**
+ * Returns how many huge pages back the buffer, as reported by the kernel
+ * for the mappings it overlaps
+ */
+size_t buffer_huge_pages(const void* buffer) {
+
+    const struct buffer_header* header = (const struct buffer_header*) ((const char*) buffer - BUFFER_HEADER);
+    if (header->length == 0) {
+        return 0;
+    }
+
+    FILE* smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL) {
+        return 0;
+    }
+
+    const uintptr_t first = (uintptr_t) buffer;
+    const uintptr_t last = first + header->length;
+
+    char line[256];
+    bool overlaps = false;
+    size_t kilobytes = 0;
+
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        uintptr_t start, end;
+        size_t amount;
+
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2) {
+            overlaps = start < last && end > first;
+        } else if (overlaps &&
+                   (sscanf(line, "AnonHugePages: %zu kB", &amount) == 1 ||
+                    sscanf(line, "Private_Hugetlb: %zu kB", &amount) == 1 ||
+                    sscanf(line, "Shared_Hugetlb: %zu kB", &amount) == 1)) {
+            kilobytes += amount;
+        }
+    }
+
+    fclose(smaps);
+
+    return kilobytes * 1024 / BUFFER_HUGE;
+}
@@ -0,0 +1,31 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+
+/* bytes of released buffers kept for reuse unless configured otherwise */
+#define BUFFER_DEFAULT_LIMIT ((size_t) 1 << 30)
+
+/* file data mapped by buffer_map_file starts this far into the file */
+#define BUFFER_PAGE 4096
+
+/* buffers at least this large are mapped on their own, aligned to it */
+#define BUFFER_HUGE ((size_t) 2 << 20)
+
+enum buffer_pages {
+    BUFFER_PAGES_DEFAULT,
+    BUFFER_PAGES_THP,
+    BUFFER_PAGES_HUGETLB
+};
+
+void buffer_set_limit(size_t bytes);
+void buffer_set_pages(enum buffer_pages pages);
+
+void* buffer_alloc(size_t bytes);
+void buffer_free(void* buffer);
+
+void* buffer_map_file(int fd, size_t bytes);
+
+size_t buffer_huge_pages(const void* buffer);
+
+#endif
@@ -0,0 +1,805 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "expr.h"
+#include "matrix.h"
+#include "pool.h"
+#include "simd.h"
+
+/*
+ * Lazily evaluated matrix expressions.
+ *
+ * SET records elementwise operations as nodes over their operands instead
+ * of running them. When a value is needed the whole chain is evaluated in
+ * one parallel pass: each thread walks its range in cache-sized blocks,
+ * evaluating the tree for a block into small scratch buffers, so the
+ * intermediate matrices are never materialised. A forced node keeps its
+ * result and drops its operands.
+ *
+ * Nodes are immutable and reference counted, so cloning shares the node
+ * and its buffer. Evaluation writes in place into an operand's buffer
+ * when nothing else can still reach it, and into a new buffer otherwise.
+ *
+ * identity, uniform and sequence matrices are kept as structured kinds
+ * described by their parameters. Operations that map them onto another
+ * structured kind fold at construction, computations on them use closed
+ * forms, and they are only generated when a dense result needs them.
+ */
+
+#define EXPR_BLOCK 1024
+
+/* blocks per chunk handed out when evaluating in parallel */
+#define EXPR_GRAIN 16
+
+/*
+ * Frequency queries on a dense matrix answered by scanning before it is
+ * indexed. Building the index costs about 10 to 16 scans, so indexing
+ * after that many queries keeps any workload within about twice the cost
+ * of scanning every time.
+ */
+#define EXPR_INDEX_AFTER 16
+
+/*
+ * Default largest matrix indexed, an order of 16384. The index keeps a
+ * sorted copy, and the build briefly needs a second copy for scratch, so
+ * an indexed matrix peaks at three times its own size.
+ */
+#define EXPR_INDEX_LIMIT ((size_t) 1 << 30)
+
+enum expr_op {
+    EXPR_MATRIX,
+    EXPR_IDENTITY,
+    EXPR_UNIFORM,
+    EXPR_SEQUENCE,
+    EXPR_REVERSED,
+    EXPR_SCALAR_ADD,
+    EXPR_SCALAR_MUL,
+    EXPR_MATRIX_ADD
+};
+
+struct expr {
+    ssize_t refs;
+    enum expr_op op;
+    uint32_t scalar;
+    uint32_t step;
+    expr* args[2];
+    uint32_t* matrix;
+    ssize_t nodes;
+    ssize_t queries;
+    struct matrix_index* index;
+};
+
+struct expr_job {
+    const expr* root;
+    uint32_t* result;
+    ssize_t scratch;
+};
+
+struct expr_scan {
+    const expr* root;
+};
+
+static ssize_t g_order = 0;
+static ssize_t g_elements = 0;
+static size_t g_index_limit = EXPR_INDEX_LIMIT;
+
+/**
+ * Sets the order of the matrices expressions evaluate to
+ */
+void expr_init(ssize_t order) {
+
+    g_order = order;
+    g_elements = order * order;
+}
+
+/**
+ * Sets the largest matrix in bytes that frequency queries may index
+ */
+void expr_set_index_limit(size_t bytes) {
+
+    g_index_limit = bytes;
+}
+
+/**
+ * Returns whether matrices of the current order are small enough to index
+ */
+bool expr_indexable(void) {
+
+    return g_elements * sizeof(uint32_t) <= g_index_limit;
+}
+
+/**
+ * Returns whether e is uniform or a sequence, and if so its start and step
+ */
+static bool progression(const expr* e, uint32_t* start, uint32_t* step) {
+
+    if (e->op != EXPR_UNIFORM && e->op != EXPR_SEQUENCE) {
+        return false;
+    }
+
+    *start = e->scalar;
+    *step = e->step;
+
+    return true;
+}
+
+/**
+ * Returns base raised to exponent, modulo 2^32
+ */
+static uint32_t power(uint32_t base, uint32_t exponent) {
+
+    uint32_t result = 1;
+
+    while (exponent > 0) {
+        if (exponent & 1) {
+            result *= base;
+        }
+        base *= base;
+        exponent >>= 1;
+    }
+
+    return result;
+}
+
+////////////////////////////////
+///       CONSTRUCTION       ///
+////////////////////////////////
+
+static expr* new_expr(enum expr_op op) {
+
+    expr* e = calloc(1, sizeof(expr));
+    if (!e) {
+        perror("calloc");
+        exit(1);
+    }
+
+    e->refs = 1;
+    e->op = op;
+
+    return e;
+}
+
+/**
+ * Returns a node for an operation on one or two operands, forcing it at
+ * once if the expression has grown past EXPR_MAX_NODES
+ */
+static expr* new_node(enum expr_op op, uint32_t scalar, expr* a, expr* b) {
+
+    expr* e = new_expr(op);
+
+    e->scalar = scalar;
+    e->args[0] = a;
+    e->args[1] = b;
+    e->nodes = 1 + a->nodes + (b == NULL ? 0 : b->nodes);
+
+    expr_retain(a);
+    if (b != NULL) {
+        expr_retain(b);
+    }
+
+    if (e->nodes > EXPR_MAX_NODES) {
+        expr_force(e);
+    }
+
+    return e;
+}
+
+/**
+ * Returns an expression holding the given matrix, taking ownership of it
+ */
+expr* expr_matrix(uint32_t* matrix) {
+
+    expr* e = new_expr(EXPR_MATRIX);
+    e->matrix = matrix;
+
+    return e;
+}
+
+expr* expr_identity(void) {
+
+    return new_expr(EXPR_IDENTITY);
+}
+
+expr* expr_uniform(uint32_t value) {
+
+    expr* e = new_expr(EXPR_UNIFORM);
+    e->scalar = value;
+
+    return e;
+}
+
+expr* expr_sequence(uint32_t start, uint32_t step) {
+
+    if (step == 0) {
+        return expr_uniform(start);
+    }
+
+    expr* e = new_expr(EXPR_SEQUENCE);
+    e->scalar = start;
+    e->step = step;
+
+    return e;
+}
+
+/**
+ * Expressions are immutable, so a clone shares e in O(1)
+ */
+expr* expr_cloned(expr* e) {
+
+    expr_retain(e);
+    return e;
+}
+
+/**
+ * Identity and uniform matrices are their own reverse, and a reversed
+ * sequence counts down from its last element
+ */
+expr* expr_reversed(expr* e) {
+
+    if (e->op == EXPR_IDENTITY || e->op == EXPR_UNIFORM) {
+        expr_retain(e);
+        return e;
+    }
+
+    if (e->op == EXPR_SEQUENCE) {
+        return expr_sequence(e->scalar + (uint32_t) (g_elements - 1) * e->step, -e->step);
+    }
+
+    return new_node(EXPR_REVERSED, 0, e, NULL);
+}
+
+expr* expr_transposed(expr* e) {
+
+    if (e->op == EXPR_IDENTITY || e->op == EXPR_UNIFORM) {
+        expr_retain(e);
+        return e;
+    }
+
+    return expr_matrix(transposed(expr_force(e)));
+}
+
+expr* expr_scalar_add(expr* e, uint32_t scalar) {
+
+    uint32_t start, step;
+    if (progression(e, &start, &step)) {
+        return expr_sequence(start + scalar, step);
+    }
+
+    return new_node(EXPR_SCALAR_ADD, scalar, e, NULL);
+}
+
+expr* expr_scalar_mul(expr* e, uint32_t scalar) {
+
+    uint32_t start, step;
+    if (scalar == 0) {
+        return expr_uniform(0);
+    } else if (progression(e, &start, &step)) {
+        return expr_sequence(start * scalar, step * scalar);
+    }
+
+    return new_node(EXPR_SCALAR_MUL, scalar, e, NULL);
+}
+
+expr* expr_matrix_add(expr* a, expr* b) {
+
+    uint32_t start_a, step_a, start_b, step_b;
+    if (progression(a, &start_a, &step_a) && progression(b, &start_b, &step_b)) {
+        return expr_sequence(start_a + start_b, step_a + step_b);
+    }
+
+    return new_node(EXPR_MATRIX_ADD, 0, a, b);
+}
+
+/**
+ * Multiplying by the identity is a copy, and every element of a product
+ * of uniform matrices is the same dot product of order terms
+ */
+expr* expr_matrix_mul(expr* a, expr* b) {
+
+    if (a->op == EXPR_IDENTITY) {
+        return expr_cloned(b);
+    } else if (b->op == EXPR_IDENTITY) {
+        return expr_cloned(a);
+    } else if (a->op == EXPR_UNIFORM && b->op == EXPR_UNIFORM) {
+        return expr_uniform(a->scalar * b->scalar * (uint32_t) g_order);
+    }
+
+    const uint32_t* matrix_a = expr_force(a);
+    const uint32_t* matrix_b = expr_force(b);
+
+    return expr_matrix(matrix_mul(matrix_a, matrix_b));
+}
+
+/**
+ * Powers of the identity are the identity, and the kth power of uniform
+ * value c is uniform c^k * order^(k - 1)
+ */
+expr* expr_matrix_pow(expr* e, uint32_t exponent) {
+
+    if (exponent == 0 || e->op == EXPR_IDENTITY) {
+        return expr_identity();
+    } else if (e->op == EXPR_UNIFORM) {
+        return expr_uniform(power(e->scalar, exponent) * power(g_order, exponent - 1));
+    } else if (exponent == 1) {
+        return expr_cloned(e);
+    }
+
+    return expr_matrix(matrix_pow(expr_force(e), exponent));
+}
+
+////////////////////////////////
+///        EVALUATION        ///
+////////////////////////////////
+
+/**
+ * Returns how many scratch blocks evaluating e needs besides its output
+ */
+static ssize_t scratch_blocks(const expr* e) {
+
+    switch (e->matrix != NULL ? EXPR_MATRIX : e->op) {
+        case EXPR_MATRIX:
+        case EXPR_IDENTITY:
+        case EXPR_UNIFORM:
+        case EXPR_SEQUENCE:
+            return 0;
+
+        case EXPR_MATRIX_ADD: {
+            const ssize_t a = 1 + scratch_blocks(e->args[0]);
+            const ssize_t b = 2 + scratch_blocks(e->args[1]);
+            return a > b ? a : b;
+        }
+
+        default:
+            return 1 + scratch_blocks(e->args[0]);
+    }
+}
+
+/**
+ * Evaluates elements [start, start + count) of e, count <= EXPR_BLOCK.
+ * Returns a pointer to them, either into a materialised matrix or dst,
+ * using the blocks from scratch onwards for operands.
+ */
+static const uint32_t* eval_block(const expr* e, ssize_t start, ssize_t count,
+                                  uint32_t* dst, uint32_t* scratch) {
+
+    if (e->matrix != NULL) {
+        return e->matrix + start;
+    }
+
+    const uint32_t* a;
+    const uint32_t* b;
+
+    switch (e->op) {
+        case EXPR_IDENTITY: {
+            /* diagonal elements are every (order + 1)th */
+            const ssize_t stride = g_order + 1;
+            simd_fill(dst, 0, count);
+            for (ssize_t i = (start + stride - 1) / stride * stride; i < start + count; i += stride) {
+                dst[i - start] = 1;
+            }
+            return dst;
+        }
+
+        case EXPR_UNIFORM:
+            simd_fill(dst, e->scalar, count);
+            return dst;
+
+        case EXPR_SEQUENCE:
+            simd_sequence(dst, e->scalar + (uint32_t) start * e->step, e->step, count);
+            return dst;
+
+        case EXPR_REVERSED:
+            a = eval_block(e->args[0], g_elements - start - count, count, scratch, scratch + EXPR_BLOCK);
+            for (ssize_t i = 0; i < count; i++) {
+                dst[i] = a[count - 1 - i];
+            }
+            return dst;
+
+        case EXPR_SCALAR_ADD:
+            a = eval_block(e->args[0], start, count, scratch, scratch + EXPR_BLOCK);
+            simd_add_scalar(dst, a, e->scalar, count);
+            return dst;
+
+        case EXPR_SCALAR_MUL:
+            a = eval_block(e->args[0], start, count, scratch, scratch + EXPR_BLOCK);
+            simd_mul_scalar(dst, a, e->scalar, count);
+            return dst;
+
+        case EXPR_MATRIX_ADD:
+            a = eval_block(e->args[0], start, count, scratch, scratch + EXPR_BLOCK);
+            b = eval_block(e->args[1], start, count, scratch + EXPR_BLOCK, scratch + 2 * EXPR_BLOCK);
+            simd_add(dst, a, b, count);
+            return dst;
+
+        default:
+            return dst;
+    }
+}
+
+static void eval_worker(void* arg, ssize_t start, ssize_t end) {
+
+    const struct expr_job* job = (const struct expr_job*) arg;
+
+    uint32_t* scratch = aligned_alloc(64, (job->scratch + 1) * EXPR_BLOCK * sizeof(uint32_t));
+    if (!scratch) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+
+    for (ssize_t block = start; block < end; block++) {
+        const ssize_t first = block * EXPR_BLOCK;
+        const ssize_t count = g_elements - first < EXPR_BLOCK ? g_elements - first : EXPR_BLOCK;
+
+        uint32_t* dst = job->result + first;
+        const uint32_t* values = eval_block(job->root, first, count, dst, scratch);
+        if (values != dst) {
+            simd_copy(dst, values, count);
+        }
+    }
+
+    free(scratch);
+}
+
+/**
+ * Counts the matrices evaluating e reads element by element, and the
+ * arithmetic nodes applied to each element
+ */
+static void eval_traffic(const expr* e, uint64_t* reads, uint64_t* ops) {
+
+    if (e->matrix != NULL) {
+        *reads += 1;
+        return;
+    }
+
+    switch (e->op) {
+        case EXPR_IDENTITY:
+        case EXPR_UNIFORM:
+        case EXPR_SEQUENCE:
+            return;
+
+        case EXPR_MATRIX_ADD:
+            *ops += 1;
+            eval_traffic(e->args[0], reads, ops);
+            eval_traffic(e->args[1], reads, ops);
+            return;
+
+        default:
+            *ops += e->op != EXPR_REVERSED;
+            eval_traffic(e->args[0], reads, ops);
+            return;
+    }
+}
+
+/**
+ * Returns a materialised operand of e whose buffer can take the result,
+ * or NULL. Only e may reach it, so every node on the way must be
+ * referenced once, and no reversal may lie between, so that each element
+ * is read in the block that overwrites it.
+ */
+static expr* find_donor(expr* e, bool root) {
+
+    if (!root && e->refs != 1) {
+        return NULL;
+    }
+
+    if (e->matrix != NULL) {
+        return root ? NULL : e;
+    }
+
+    expr* donor;
+
+    switch (e->op) {
+        case EXPR_SCALAR_ADD:
+        case EXPR_SCALAR_MUL:
+            return find_donor(e->args[0], false);
+
+        case EXPR_MATRIX_ADD:
+            donor = find_donor(e->args[0], false);
+            return donor != NULL ? donor : find_donor(e->args[1], false);
+
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * Returns the value of e, evaluating and storing it on first use
+ */
+const uint32_t* expr_force(expr* e) {
+
+    if (e->matrix != NULL) {
+        return e->matrix;
+    }
+
+    expr* donor = find_donor(e, true);
+
+    struct expr_job job = {
+        .root = e,
+        .result = donor != NULL ? donor->matrix : alloc_matrix(),
+        .scratch = scratch_blocks(e)
+    };
+
+    pool_steal(eval_worker, &job, (g_elements + EXPR_BLOCK - 1) / EXPR_BLOCK, EXPR_GRAIN);
+
+    uint64_t reads = 0, ops = 0;
+    eval_traffic(e, &reads, &ops);
+    add_traffic(reads * g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t),
+                ops * g_elements);
+
+    /* the donor is released along with the operands below */
+    if (donor != NULL) {
+        donor->matrix = NULL;
+    }
+
+    e->matrix = job.result;
+    e->nodes = 0;
+
+    /* structured kinds keep their tag for the closed forms */
+    if (e->args[0] != NULL) {
+        e->op = EXPR_MATRIX;
+        for (int i = 0; i < 2; i++) {
+            expr_release(e->args[i]);
+            e->args[i] = NULL;
+        }
+    }
+
+    return e->matrix;
+}
+
+/**
+ * Returns the value of e if it has been materialised, NULL otherwise
+ */
+const uint32_t* expr_value(const expr* e) {
+
+    return e->matrix;
+}
+
+/**
+ * Returns whether frequency queries on e are answered from an index
+ */
+bool expr_indexed(const expr* e) {
+
+    return e->index != NULL;
+}
+
+////////////////////////////////
+///       COMPUTATIONS       ///
+////////////////////////////////
+
+/**
+ * Scans an unmaterialised expression block by block, without storing it
+ */
+
+static void scan_worker(void* arg, ssize_t start, ssize_t end, void* partial) {
+
+    const struct expr_scan* job = (const struct expr_scan*) arg;
+    struct simd_scan* scan = (struct simd_scan*) partial;
+
+    uint32_t block[EXPR_BLOCK] __attribute__((aligned(64)));
+
+    for (ssize_t index = start; index < end; index++) {
+        const ssize_t first = index * EXPR_BLOCK;
+        const ssize_t count = g_elements - first < EXPR_BLOCK ? g_elements - first : EXPR_BLOCK;
+
+        simd_scan(eval_block(job->root, first, count, block, NULL), count, 0, scan);
+    }
+}
+
+static void scan_combine(void* result, const void* partial) {
+
+    struct simd_scan* total = (struct simd_scan*) result;
+    const struct simd_scan* part = (const struct simd_scan*) partial;
+
+    total->sum += part->sum;
+    total->minimum = part->minimum < total->minimum ? part->minimum : total->minimum;
+    total->maximum = part->maximum > total->maximum ? part->maximum : total->maximum;
+    total->count += part->count;
+}
+
+static struct simd_scan scan_generated(const expr* e) {
+
+    struct expr_scan job = {
+        .root = e
+    };
+
+    struct simd_scan scan = {
+        .sum = 0,
+        .minimum = UINT32_MAX,
+        .maximum = 0,
+        .count = 0
+    };
+
+    pool_reduce(scan_worker, scan_combine, &job, (g_elements + EXPR_BLOCK - 1) / EXPR_BLOCK,
+                &scan, sizeof(scan));
+
+    uint64_t reads = 0, ops = 0;
+    eval_traffic(e, &reads, &ops);
+    add_traffic(reads * g_elements * sizeof(uint32_t), 0, (ops + 1) * g_elements);
+
+    return scan;
+}
+
+/**
+ * Returns the smallest and largest element of a progression in O(1) when
+ * it does not wrap around 2^32, scanning it as generated otherwise
+ */
+static void progression_bounds(const expr* e, uint32_t* minimum, uint32_t* maximum) {
+
+    const uint64_t last = g_elements - 1;
+    const uint32_t start = e->scalar;
+    const uint32_t step = e->step;
+
+    if ((uint64_t) start + step * last <= UINT32_MAX) {
+        *minimum = start;
+        *maximum = start + (uint32_t) last * step;
+    } else if ((uint64_t) (uint32_t) -step * last <= start) {
+        *minimum = start + (uint32_t) last * step;
+        *maximum = start;
+    } else {
+        const struct simd_scan scan = scan_generated(e);
+        *minimum = scan.minimum;
+        *maximum = scan.maximum;
+    }
+}
+
+/**
+ * Returns how many i in [0, elements) satisfy start + i * step == value
+ * modulo 2^32, by solving the linear congruence i * step == value - start
+ */
+static uint32_t progression_frequency(uint32_t start, uint32_t step, uint32_t value) {
+
+    const uint32_t difference = value - start;
+
+    if (step == 0) {
+        return difference == 0 ? g_elements : 0;
+    }
+
+    /* step = odd * 2^shift has solutions only when 2^shift divides difference */
+    const int shift = __builtin_ctz(step);
+    if (difference & ((UINT32_C(1) << shift) - 1)) {
+        return 0;
+    }
+
+    const uint32_t odd = step >> shift;
+    const uint64_t period = UINT64_C(1) << (32 - shift);
+
+    /* Newton's iteration doubles the correct low bits of the inverse */
+    uint32_t inverse = odd;
+    for (int i = 0; i < 4; i++) {
+        inverse *= 2 - odd * inverse;
+    }
+
+    const uint64_t first = (uint64_t) ((difference >> shift) * inverse) & (period - 1);
+    if (first >= (uint64_t) g_elements) {
+        return 0;
+    }
+
+    return (g_elements - 1 - first) / period + 1;
+}
+
+uint32_t expr_sum(expr* e) {
+
+    uint32_t start, step;
+
+    if (e->op == EXPR_IDENTITY) {
+        return g_order;
+    } else if (progression(e, &start, &step)) {
+        const uint64_t n = g_elements;
+        return start * (uint32_t) n + step * (uint32_t) (n * (n - 1) / 2);
+    }
+
+    return get_sum(expr_force(e));
+}
+
+uint32_t expr_trace(expr* e) {
+
+    uint32_t start, step;
+
+    if (e->op == EXPR_IDENTITY) {
+        return g_order;
+    } else if (progression(e, &start, &step)) {
+        /* the ith diagonal element is at index i * (order + 1) */
+        const uint64_t n = g_order;
+        return start * (uint32_t) n + step * (uint32_t) ((n + 1) * (n * (n - 1) / 2));
+    }
+
+    return get_trace(expr_force(e));
+}
+
+uint32_t expr_minimum(expr* e) {
+
+    uint32_t minimum, maximum;
+
+    if (e->op == EXPR_IDENTITY) {
+        return g_elements == 1 ? 1 : 0;
+    } else if (e->op == EXPR_UNIFORM || e->op == EXPR_SEQUENCE) {
+        progression_bounds(e, &minimum, &maximum);
+        return minimum;
+    }
+
+    return get_minimum(expr_force(e));
+}
+
+uint32_t expr_maximum(expr* e) {
+
+    uint32_t minimum, maximum;
+
+    if (e->op == EXPR_IDENTITY) {
+        return 1;
+    } else if (e->op == EXPR_UNIFORM || e->op == EXPR_SEQUENCE) {
+        progression_bounds(e, &minimum, &maximum);
+        return maximum;
+    }
+
+    return get_maximum(expr_force(e));
+}
+
+uint32_t expr_frequency(expr* e, uint32_t value) {
+
+    uint32_t start, step;
+
+    if (e->op == EXPR_IDENTITY) {
+        return value == 1 ? g_order : value == 0 ? g_elements - g_order : 0;
+    } else if (progression(e, &start, &step)) {
+        return progression_frequency(start, step, value);
+    }
+
+    const uint32_t* matrix = expr_force(e);
+
+    if (e->index == NULL && ++e->queries > EXPR_INDEX_AFTER && expr_indexable()) {
+        e->index = index_matrix(matrix);
+    }
+
+    return e->index != NULL ? index_frequency(e->index, value) : get_frequency(matrix, value);
+}
+
+struct matrix_stats expr_stats(expr* e, uint32_t value) {
+
+    if (e->op != EXPR_IDENTITY && e->op != EXPR_UNIFORM && e->op != EXPR_SEQUENCE) {
+        return get_stats(expr_force(e), value);
+    }
+
+    struct matrix_stats stats = {
+        .sum = expr_sum(e),
+        .trace = expr_trace(e),
+        .frequency = expr_frequency(e, value)
+    };
+
+    if (e->op == EXPR_IDENTITY) {
+        stats.minimum = expr_minimum(e);
+        stats.maximum = expr_maximum(e);
+    } else {
+        progression_bounds(e, &stats.minimum, &stats.maximum);
+    }
+
+    return stats;
+}
+
+////////////////////////////////
+///         LIFETIME         ///
+////////////////////////////////
+
+void expr_retain(expr* e) {
+
+    e->refs += 1;
+}
+
+/**
+ * Drops a reference, freeing the node, its matrix and its operand
+ * references once the last one is gone
+ */
+void expr_release(expr* e) {
+
+    if (e == NULL || --e->refs > 0) {
+        return;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        expr_release(e->args[i]);
+    }
+
+    release_matrix(e->matrix);
+    release_index(e->index);
+    free(e);
+}
@@ -0,0 +1,53 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "matrix.h"
+
+/* pending operations in one expression before it is forced regardless */
+#define EXPR_MAX_NODES 32
+
+typedef struct expr expr;
+
+void expr_init(ssize_t order);
+void expr_set_index_limit(size_t bytes);
+bool expr_indexable(void);
+
+/* construction, each returns a new reference */
+
+expr* expr_matrix(uint32_t* matrix);
+expr* expr_identity(void);
+expr* expr_uniform(uint32_t value);
+expr* expr_sequence(uint32_t start, uint32_t step);
+
+expr* expr_cloned(expr* e);
+expr* expr_reversed(expr* e);
+expr* expr_transposed(expr* e);
+
+expr* expr_scalar_add(expr* e, uint32_t scalar);
+expr* expr_scalar_mul(expr* e, uint32_t scalar);
+expr* expr_matrix_pow(expr* e, uint32_t exponent);
+expr* expr_matrix_add(expr* a, expr* b);
+expr* expr_matrix_mul(expr* a, expr* b);
+
+/* evaluation and lifetime */
+
+const uint32_t* expr_force(expr* e);
+const uint32_t* expr_value(const expr* e);
+bool expr_indexed(const expr* e);
+
+/* computations, in closed form for structured kinds */
+
+uint32_t expr_sum(expr* e);
+uint32_t expr_trace(expr* e);
+uint32_t expr_minimum(expr* e);
+uint32_t expr_maximum(expr* e);
+uint32_t expr_frequency(expr* e, uint32_t value);
+struct matrix_stats expr_stats(expr* e, uint32_t value);
+
+void expr_retain(expr* e);
+void expr_release(expr* e);
+
+#endif
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "format.h"
+
+/*
+ * Integer formatting and raw output for bulk display. Values are
+ * converted two digits at a time from a lookup table straight into the
+ * caller's buffer, which is written to standard output with write(2)
+ * once stdio has flushed anything already printed.
+ */
+
+static const char DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static int count_digits(uint32_t value) {
+
+    if (value < 10) return 1;
+    if (value < 100) return 2;
+    if (value < 1000) return 3;
+    if (value < 10000) return 4;
+    if (value < 100000) return 5;
+    if (value < 1000000) return 6;
+    if (value < 10000000) return 7;
+    if (value < 100000000) return 8;
+    if (value < 1000000000) return 9;
+    return 10;
+}
+
+/**
+ * Writes value in decimal at out, returning the end of the digits
+ */
+char* format_u32(char* out, uint32_t value) {
+
+    char* const end = out + count_digits(value);
+    char* p = end;
+
+    while (value >= 100) {
+        const uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + pair, 2);
+    }
+
+    if (value >= 10) {
+        memcpy(p - 2, DIGIT_PAIRS + value * 2, 2);
+    } else {
+        p[-1] = (char) ('0' + value);
+    }
+
+    return end;
+}
+
+/**
+ * Writes count values, stride elements apart, separated by separator and
+ * followed by terminator. Needs count * (FORMAT_U32_MAX + 1) bytes.
+ */
+char* format_values(char* out, const uint32_t* values, ssize_t count, ssize_t stride,
+                    char separator, char terminator) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        out = format_u32(out, values[i * stride]);
+        *out++ = i + 1 < count ? separator : terminator;
+    }
+
+    return out;
+}
+
+/**
+ * Writes the buffers in order to standard output, after anything
+ * buffered by stdio
+ */
+void format_writev(struct iovec* iov, int count) {
+
+    fflush(stdout);
+
+    while (count > 0) {
+        const ssize_t written = writev(STDOUT_FILENO, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        /* skip what was written, resuming part way into a buffer if needed */
+        size_t remaining = written;
+        while (count > 0 && remaining >= iov->iov_len) {
+            remaining -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*) iov->iov_base + remaining;
+            iov->iov_len -= remaining;
+        }
+    }
+}
+
+void format_write(const char* data, size_t length) {
+
+    struct iovec iov = {
+        .iov_base = (void*) data,
+        .iov_len = length
+    };
+
+    format_writev(&iov, 1);
+}
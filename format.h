@@ -0,0 +1,19 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* longest decimal uint32 */
+#define FORMAT_U32_MAX 10
+
+char* format_u32(char* out, uint32_t value);
+char* format_values(char* out, const uint32_t* values, ssize_t count, ssize_t stride,
+                    char separator, char terminator);
+
+void format_write(const char* data, size_t length);
+void format_writev(struct iovec* iov, int count);
+
+#endif
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "gemm.h"
+#include "pool.h"
+#include "simd.h"
+
+/*
+ * Blocked uint32 matrix multiply (C = A * B, mod 2^32).
+ *
+ * C is cut into MC x NC tiles which are shared out across the pool. For
+ * each KC slice of the inner dimension a thread packs its A block (L2)
+ * and B panel (L3) into contiguous MR-tall and NR-wide micro-panels, then
+ * sweeps the micro-kernel across them, keeping an MR x NR tile of C in
+ * vector registers for the whole slice.
+ */
+
+#define MR 6
+#define NR 16
+
+#define MC 96
+#define KC 256
+#define NC 256
+
+typedef uint32_t v16u __attribute__((vector_size(64)));
+
+typedef void (*kernel_fn)(ssize_t kc, const uint32_t* a, const uint32_t* b,
+                          uint32_t* c, ssize_t ldc, bool accumulate);
+
+struct gemm_buffers {
+    uint32_t* a;
+    uint32_t* b;
+};
+
+static kernel_fn g_kernel = NULL;
+
+static ssize_t g_nbuffers = 0;
+static struct gemm_buffers* g_buffers = NULL;
+
+struct gemm_job {
+    ssize_t m;
+    ssize_t n;
+    ssize_t k;
+    const uint32_t* a;
+    ssize_t lda;
+    const uint32_t* b;
+    ssize_t ldb;
+    uint32_t* c;
+    ssize_t ldc;
+    bool accumulate;
+    ssize_t mc;
+    ssize_t nc;
+    ssize_t col_tiles;
+};
+
+////////////////////////////////
+///       MICRO-KERNEL       ///
+////////////////////////////////
+
+#define STORE16(p, v, accumulate) do { \
+        v16u out = (v); \
+        if (accumulate) { \
+            v16u prev; \
+            memcpy(&prev, (p), sizeof(prev)); \
+            out += prev; \
+        } \
+        memcpy((p), &out, sizeof(out)); \
+    } while (0)
+
+/**
+ * Multiplies an MR x kc packed A micro-panel by a kc x NR packed B
+ * micro-panel into C, either overwriting or accumulating
+ */
+static inline __attribute__((always_inline))
+void kernel_body(ssize_t kc, const uint32_t* a, const uint32_t* b,
+                 uint32_t* c, ssize_t ldc, bool accumulate) {
+
+    v16u c0 = {0}, c1 = {0}, c2 = {0}, c3 = {0}, c4 = {0}, c5 = {0};
+
+    for (ssize_t p = 0; p < kc; p++) {
+        v16u bv;
+        memcpy(&bv, b, sizeof(bv));
+
+        c0 += a[0] * bv;
+        c1 += a[1] * bv;
+        c2 += a[2] * bv;
+        c3 += a[3] * bv;
+        c4 += a[4] * bv;
+        c5 += a[5] * bv;
+
+        a += MR;
+        b += NR;
+    }
+
+    STORE16(c + 0 * ldc, c0, accumulate);
+    STORE16(c + 1 * ldc, c1, accumulate);
+    STORE16(c + 2 * ldc, c2, accumulate);
+    STORE16(c + 3 * ldc, c3, accumulate);
+    STORE16(c + 4 * ldc, c4, accumulate);
+    STORE16(c + 5 * ldc, c5, accumulate);
+}
+
+__attribute__((target("avx512f")))
+static void kernel_avx512(ssize_t kc, const uint32_t* a, const uint32_t* b,
+                          uint32_t* c, ssize_t ldc, bool accumulate) {
+
+    kernel_body(kc, a, b, c, ldc, accumulate);
+}
+
+__attribute__((target("avx2")))
+static void kernel_avx2(ssize_t kc, const uint32_t* a, const uint32_t* b,
+                        uint32_t* c, ssize_t ldc, bool accumulate) {
+
+    kernel_body(kc, a, b, c, ldc, accumulate);
+}
+
+static void kernel_generic(ssize_t kc, const uint32_t* a, const uint32_t* b,
+                           uint32_t* c, ssize_t ldc, bool accumulate) {
+
+    kernel_body(kc, a, b, c, ldc, accumulate);
+}
+
+////////////////////////////////
+///          PACKING         ///
+////////////////////////////////
+
+/**
+ * Packs an mc x kc block of A into MR-tall micro-panels, zero padded
+ */
+static void pack_a(ssize_t mc, ssize_t kc, const uint32_t* a, ssize_t lda, uint32_t* packed) {
+
+    for (ssize_t ir = 0; ir < mc; ir += MR) {
+        const ssize_t rows = mc - ir < MR ? mc - ir : MR;
+
+        for (ssize_t p = 0; p < kc; p++) {
+            for (ssize_t i = 0; i < rows; i++) {
+                packed[i] = a[(ir + i) * lda + p];
+            }
+            for (ssize_t i = rows; i < MR; i++) {
+                packed[i] = 0;
+            }
+            packed += MR;
+        }
+    }
+}
+
+/**
+ * Packs a kc x nc panel of B into NR-wide micro-panels, zero padded
+ */
+static void pack_b(ssize_t kc, ssize_t nc, const uint32_t* b, ssize_t ldb, uint32_t* packed) {
+
+    for (ssize_t jr = 0; jr < nc; jr += NR) {
+        const ssize_t cols = nc - jr < NR ? nc - jr : NR;
+
+        for (ssize_t p = 0; p < kc; p++) {
+            memcpy(packed, b + p * ldb + jr, cols * sizeof(uint32_t));
+            memset(packed + cols, 0, (NR - cols) * sizeof(uint32_t));
+            packed += NR;
+        }
+    }
+}
+
+////////////////////////////////
+///          DRIVER          ///
+////////////////////////////////
+
+/**
+ * Selects the micro-kernel and sizes the per-thread packing buffers
+ */
+void gemm_init(ssize_t nthreads) {
+
+    switch (simd_level()) {
+        case SIMD_AVX512:
+            g_kernel = kernel_avx512;
+            break;
+        case SIMD_AVX2:
+            g_kernel = kernel_avx2;
+            break;
+        default:
+            g_kernel = kernel_generic;
+            break;
+    }
+
+    for (ssize_t i = 0; i < g_nbuffers; i++) {
+        free(g_buffers[i].a);
+        free(g_buffers[i].b);
+    }
+    free(g_buffers);
+
+    g_nbuffers = nthreads < 1 ? 1 : nthreads;
+    g_buffers = calloc(g_nbuffers, sizeof(struct gemm_buffers));
+    if (!g_buffers) {
+        perror("calloc");
+        exit(1);
+    }
+}
+
+/**
+ * Returns the packing buffers of the calling thread, allocating on first use
+ */
+static struct gemm_buffers* thread_buffers(void) {
+
+    struct gemm_buffers* buffers = g_buffers + pool_tid();
+
+    if (buffers->a == NULL) {
+        buffers->a = aligned_alloc(64, MC * KC * sizeof(uint32_t));
+        buffers->b = aligned_alloc(64, KC * NC * sizeof(uint32_t));
+        if (!buffers->a || !buffers->b) {
+            perror("aligned_alloc");
+            exit(1);
+        }
+    }
+
+    return buffers;
+}
+
+/**
+ * Computes one mc x nc tile of C from its row block of A and column panel of B
+ */
+static void gemm_tile(const struct gemm_job* job, ssize_t ic, ssize_t jc, ssize_t mc, ssize_t nc) {
+
+    struct gemm_buffers* buffers = thread_buffers();
+    uint32_t edge[MR * NR];
+
+    for (ssize_t pc = 0; pc < job->k; pc += KC) {
+        const ssize_t kc = job->k - pc < KC ? job->k - pc : KC;
+        const bool accumulate = pc > 0 || job->accumulate;
+
+        pack_b(kc, nc, job->b + pc * job->ldb + jc, job->ldb, buffers->b);
+        pack_a(mc, kc, job->a + ic * job->lda + pc, job->lda, buffers->a);
+
+        for (ssize_t jr = 0; jr < nc; jr += NR) {
+            const ssize_t cols = nc - jr < NR ? nc - jr : NR;
+            const uint32_t* bp = buffers->b + jr * kc;
+
+            for (ssize_t ir = 0; ir < mc; ir += MR) {
+                const ssize_t rows = mc - ir < MR ? mc - ir : MR;
+                const uint32_t* ap = buffers->a + ir * kc;
+                uint32_t* c = job->c + (ic + ir) * job->ldc + jc + jr;
+
+                if (rows == MR && cols == NR) {
+                    g_kernel(kc, ap, bp, c, job->ldc, accumulate);
+                    continue;
+                }
+
+                g_kernel(kc, ap, bp, edge, NR, false);
+                for (ssize_t i = 0; i < rows; i++) {
+                    for (ssize_t j = 0; j < cols; j++) {
+                        c[i * job->ldc + j] = (accumulate ? c[i * job->ldc + j] : 0) + edge[i * NR + j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void gemm_worker(void* arg, ssize_t start, ssize_t end) {
+
+    const struct gemm_job* job = (const struct gemm_job*) arg;
+
+    for (ssize_t t = start; t < end; t++) {
+        const ssize_t ic = (t / job->col_tiles) * job->mc;
+        const ssize_t jc = (t % job->col_tiles) * job->nc;
+        const ssize_t mc = job->m - ic < job->mc ? job->m - ic : job->mc;
+        const ssize_t nc = job->n - jc < job->nc ? job->n - jc : job->nc;
+
+        gemm_tile(job, ic, jc, mc, nc);
+    }
+}
+
+/**
+ * Fills in the tiling of an m x n product, shrinking tiles until there
+ * are at least `parts` of them or they reach a single micro-tile
+ */
+static ssize_t plan_tiles(struct gemm_job* job, ssize_t parts) {
+
+    ssize_t mc = MC;
+    ssize_t nc = NC;
+
+    while (((job->m + mc - 1) / mc) * ((job->n + nc - 1) / nc) < parts) {
+        if (nc > NR && nc >= mc) {
+            nc /= 2;
+        } else if (mc > MR) {
+            mc = mc / 2 < MR ? MR : mc / 2 / MR * MR;
+        } else {
+            break;
+        }
+    }
+
+    job->mc = mc;
+    job->nc = nc;
+    job->col_tiles = (job->n + nc - 1) / nc;
+
+    return ((job->m + mc - 1) / mc) * job->col_tiles;
+}
+
+/**
+ * Computes C = A * B for an m x k matrix A and k x n matrix B, overwriting C
+ */
+void gemm(ssize_t m, ssize_t n, ssize_t k,
+          const uint32_t* a, ssize_t lda,
+          const uint32_t* b, ssize_t ldb,
+          uint32_t* c, ssize_t ldc) {
+
+    if (k == 0) {
+        for (ssize_t i = 0; i < m; i++) {
+            memset(c + i * ldc, 0, n * sizeof(uint32_t));
+        }
+        return;
+    }
+
+    struct gemm_job job = {
+        .m = m, .n = n, .k = k,
+        .a = a, .lda = lda,
+        .b = b, .ldb = ldb,
+        .c = c, .ldc = ldc
+    };
+
+    /* twice as many tiles as threads leaves some for idle threads to steal */
+    const ssize_t tiles = plan_tiles(&job, pool_size() > 1 ? 2 * pool_size() : 1);
+    pool_steal(gemm_worker, &job, tiles, 1);
+}
+
+/**
+ * Computes C += A * B for an m x k matrix A and k x n matrix B
+ */
+void gemm_add(ssize_t m, ssize_t n, ssize_t k,
+              const uint32_t* a, ssize_t lda,
+              const uint32_t* b, ssize_t ldb,
+              uint32_t* c, ssize_t ldc) {
+
+    if (k == 0) {
+        return;
+    }
+
+    struct gemm_job job = {
+        .m = m, .n = n, .k = k,
+        .a = a, .lda = lda,
+        .b = b, .ldb = ldb,
+        .c = c, .ldc = ldc,
+        .accumulate = true
+    };
+
+    const ssize_t tiles = plan_tiles(&job, pool_size() > 1 ? 2 * pool_size() : 1);
+    pool_steal(gemm_worker, &job, tiles, 1);
+}
+
+/**
+ * Computes share `part` of `parts` of the tiles of C = A * B on the
+ * calling thread, for callers that split one product across a team
+ */
+void gemm_part(ssize_t m, ssize_t n, ssize_t k,
+               const uint32_t* a, ssize_t lda,
+               const uint32_t* b, ssize_t ldb,
+               uint32_t* c, ssize_t ldc,
+               ssize_t part, ssize_t parts) {
+
+    struct gemm_job job = {
+        .m = m, .n = n, .k = k,
+        .a = a, .lda = lda,
+        .b = b, .ldb = ldb,
+        .c = c, .ldc = ldc
+    };
+
+    const ssize_t tiles = plan_tiles(&job, parts);
+    gemm_worker(&job, part * tiles / parts, (part + 1) * tiles / parts);
+}
@@ -0,0 +1,25 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+void gemm_init(ssize_t nthreads);
+
+void gemm(ssize_t m, ssize_t n, ssize_t k,
+          const uint32_t* a, ssize_t lda,
+          const uint32_t* b, ssize_t ldb,
+          uint32_t* c, ssize_t ldc);
+
+void gemm_add(ssize_t m, ssize_t n, ssize_t k,
+              const uint32_t* a, ssize_t lda,
+              const uint32_t* b, ssize_t ldb,
+              uint32_t* c, ssize_t ldc);
+
+void gemm_part(ssize_t m, ssize_t n, ssize_t k,
+               const uint32_t* a, ssize_t lda,
+               const uint32_t* b, ssize_t ldb,
+               uint32_t* c, ssize_t ldc,
+               ssize_t part, ssize_t parts);
+
+#endif
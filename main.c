@@ -6,47 +6,150 @@
 #include <strings.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
 
 #include "matrix.h"
+#include "expr.h"
 
 #define MAX_BUFFER 256
-#define MAX_ENTRIES 512
+#define MAX_WORDS 5
+#define INPUT_BLOCK (1 << 16)
+#define MIN_CAPACITY 64
 
-#define MATRIX_GUARD(x) \
-    uint32_t* m = find_matrix(x); \
-    if (m == NULL) { \
+#define EXPR_GUARD(x) \
+    expr* e1 = find_expr(x); \
+    if (e1 == NULL) { \
         puts("no such matrix"); \
         return; \
     }
 
-#define MATRIX_GUARD_PAIR(x, y) \
-    uint32_t* m1 = find_matrix(x); \
-    uint32_t* m2 = find_matrix(y); \
-    if (m1 == NULL || m2 == NULL) { \
+#define EXPR_GUARD_PAIR(x, y) \
+    expr* e1 = find_expr(x); \
+    expr* e2 = find_expr(y); \
+    if (e1 == NULL || e2 == NULL) { \
         puts("no such matrix"); \
         return; \
     }
 
+#define MATRIX_GUARD(x) \
+    EXPR_GUARD(x); \
+    const uint32_t* m = expr_force(e1);
+
+/* bits of entry.cached, one per statistic held in entry.stats */
+#define STAT_SUM       (1 << 0)
+#define STAT_TRACE     (1 << 1)
+#define STAT_MINIMUM   (1 << 2)
+#define STAT_MAXIMUM   (1 << 3)
+#define STAT_FREQUENCY (1 << 4)
+#define STAT_ALL       (STAT_SUM | STAT_TRACE | STAT_MINIMUM | STAT_MAXIMUM)
+
 typedef struct entry {
-    char key[MAX_BUFFER];
-    uint32_t* matrix;
+    char* key;
+    uint64_t hash;
+    expr* value;
+    unsigned cached;      /* statistics of value computed so far */
+    uint32_t counted;     /* value whose frequency is cached */
+    struct matrix_stats stats;
 } entry;
 
 static ssize_t g_order    = 0; /* 1 <= order <= 10,000 */
 static ssize_t g_nthreads = 0; /* 1 <= nthreads <= 256 */
-static ssize_t g_nentries = 0; /* 0 <= nentries <= 512 */
+static ssize_t g_nentries = 0; /* 0 <= nentries <= capacity / 2 */
+static ssize_t g_capacity = 0; /* power of two */
+
+/* open addressed with linear probing, empty slots have no key */
+static entry* g_entries = NULL;
+
+static bool g_batch = false;
+static bool g_timing = false;
+
+/* pending input, lines are handed out from [start, end) */
+static char* g_input = NULL;
+static size_t g_input_start = 0;
+static size_t g_input_end = 0;
+static size_t g_input_size = 0;
+static bool g_input_eof = false;
+
+/* MAX_WORDS buffers for the words of the current line */
+static char* g_words = NULL;
+static size_t g_words_size = 0;
+
+/**
+ * Returns the FNV-1a hash of key
+ */
+static uint64_t hash_key(const char* key) {
+
+    uint64_t hash = UINT64_C(14695981039346656037);
 
-static entry** g_entries = NULL;
+    for (const unsigned char* c = (const unsigned char*) key; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+/**
+ * Returns the slot holding key, or the empty slot where it belongs
+ */
+static entry* probe(const char* key, uint64_t hash) {
+
+    const ssize_t mask = g_capacity - 1;
+
+    for (ssize_t i = hash & mask; ; i = (i + 1) & mask) {
+        entry* e = g_entries + i;
+        if (e->key == NULL || (e->hash == hash && strcmp(key, e->key) == 0)) {
+            return e;
+        }
+    }
+}
 
 /**
- * Adds entry to list of entries
+ * Allocates an empty table of given capacity, moving existing entries over
+ */
+static void resize_entries(ssize_t capacity) {
+
+    entry* old = g_entries;
+    const ssize_t old_capacity = g_capacity;
+
+    g_entries = calloc(capacity, sizeof(entry));
+    if (!g_entries) {
+        perror("calloc");
+        exit(1);
+    }
+    g_capacity = capacity;
+
+    for (ssize_t i = 0; i < old_capacity; i++) {
+        if (old[i].key != NULL) {
+            *probe(old[i].key, old[i].hash) = old[i];
+        }
+    }
+
+    free(old);
+}
+
+/**
+ * Adds entry with given key, which must not exist yet
  */
 entry* add_entry(char* key) {
 
-    entry* e = calloc(1, sizeof(entry));
+    if (2 * (g_nentries + 1) > g_capacity) {
+        resize_entries(2 * g_capacity);
+    }
+
+    const uint64_t hash = hash_key(key);
+    entry* e = probe(key, hash);
 
-    strcpy(e->key, key);
-    g_entries[g_nentries] = e;
+    e->key = strdup(key);
+    if (!e->key) {
+        perror("strdup");
+        exit(1);
+    }
+    e->hash = hash;
+    e->value = NULL;
+    e->cached = 0;
     g_nentries += 1;
 
     return e;
@@ -57,19 +160,15 @@ entry* add_entry(char* key) {
  */
 entry* find_entry(char* key) {
 
-    for (ssize_t i = 0; i < g_nentries; i++) {
-        if (strcmp(key, g_entries[i]->key) == 0) {
-            return g_entries[i];
-        }
-    }
+    entry* e = probe(key, hash_key(key));
 
-    return NULL;
+    return e->key == NULL ? NULL : e;
 }
 
 /**
- * Returns matrix with given key
+ * Returns expression with given key
  */
-uint32_t* find_matrix(char* key) {
+expr* find_expr(char* key) {
 
     entry* e = find_entry(key);
 
@@ -77,7 +176,92 @@ uint32_t* find_matrix(char* key) {
         return NULL;
     }
 
-    return e->matrix;
+    return e->value;
+}
+
+/**
+ * Returns the next line of standard input without its newline, or NULL at
+ * the end. Input is read in blocks and lines may be any length.
+ */
+static char* read_line(void) {
+
+    if (g_input == NULL) {
+        g_input_size = INPUT_BLOCK;
+        g_input = malloc(g_input_size);
+        if (!g_input) {
+            perror("malloc");
+            exit(1);
+        }
+    }
+
+    while (true) {
+        char* start = g_input + g_input_start;
+        char* newline = memchr(start, '\n', g_input_end - g_input_start);
+
+        if (newline != NULL) {
+            *newline = '\0';
+            g_input_start = newline + 1 - g_input;
+            return start;
+        }
+
+        if (g_input_eof) {
+            if (g_input_start == g_input_end) {
+                return NULL;
+            }
+            g_input[g_input_end] = '\0';
+            g_input_start = g_input_end;
+            return start;
+        }
+
+        /* keep the partial line, growing the buffer if it fills it */
+        memmove(g_input, start, g_input_end - g_input_start);
+        g_input_end -= g_input_start;
+        g_input_start = 0;
+
+        if (g_input_size - g_input_end < INPUT_BLOCK / 2) {
+            g_input_size *= 2;
+            g_input = realloc(g_input, g_input_size);
+            if (!g_input) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+
+        /* responses so far must be out before waiting on more input */
+        fflush(stdout);
+
+        const ssize_t n = read(STDIN_FILENO, g_input + g_input_end, g_input_size - g_input_end - 1);
+        if (n > 0) {
+            g_input_end += n;
+        } else if (n == 0 || errno != EINTR) {
+            g_input_eof = true;
+        }
+    }
+}
+
+/**
+ * Returns MAX_WORDS buffers to scan the words of line into, each long
+ * enough for the whole line
+ */
+static char** line_words(const char* line) {
+
+    static char* words[MAX_WORDS];
+    const size_t length = strlen(line) + 1 < MAX_BUFFER ? MAX_BUFFER : strlen(line) + 1;
+
+    if (MAX_WORDS * length > g_words_size) {
+        g_words_size = MAX_WORDS * length;
+        g_words = realloc(g_words, g_words_size);
+        if (!g_words) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    for (int i = 0; i < MAX_WORDS; i++) {
+        words[i] = g_words + i * length;
+    }
+
+    return words;
 }
 
 /**
@@ -89,26 +273,102 @@ void release(void) {
         return;
     }
 
-    for (ssize_t i = 0; i < g_nentries; i++) {
-        free(g_entries[i]->matrix);
-        free(g_entries[i]);
+    for (ssize_t i = 0; i < g_capacity; i++) {
+        if (g_entries[i].key != NULL) {
+            expr_release(g_entries[i].value);
+            free(g_entries[i].key);
+        }
     }
 
     free(g_entries);
+    free(g_input);
+    free(g_words);
+
+    /* drop the buffers retained for reuse */
+    set_retained_limit(0);
 }
 
 /**
  * Defines settings based on command line arguments
  */
 void define_settings(int argc, char** argv) {
-    
-    if (argc != 3) {
+
+    static const struct option OPTIONS[] = {
+        { "strassen", required_argument, NULL, 's' },
+        { "retain", required_argument, NULL, 'r' },
+        { "index", required_argument, NULL, 'i' },
+        { "hugepages", required_argument, NULL, 'h' },
+        { "batch", no_argument, NULL, 'b' },
+        { "timing", no_argument, NULL, 't' },
+        { "pin", no_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    ssize_t strassen = -1;
+    ssize_t retain = -1;
+    ssize_t index = -1;
+    int option;
+
+    opterr = 0;
+    while ((option = getopt_long(argc, argv, "", OPTIONS, NULL)) != -1) {
+        switch (option) {
+            case 's':
+                strassen = atoll(optarg);
+                if (strassen < 0) {
+                    goto invalid;
+                }
+                break;
+
+            case 'r':
+                retain = atoll(optarg);
+                if (retain < 0) {
+                    goto invalid;
+                }
+                break;
+
+            case 'i':
+                index = atoll(optarg);
+                if (index < 0) {
+                    goto invalid;
+                }
+                break;
+
+            case 'b':
+                g_batch = true;
+                break;
+
+            case 't':
+                g_timing = true;
+                break;
+
+            case 'p':
+                set_pinning(true);
+                break;
+
+            case 'h':
+                if (strcasecmp(optarg, "none") == 0) {
+                    set_page_policy(PAGES_DEFAULT);
+                } else if (strcasecmp(optarg, "thp") == 0) {
+                    set_page_policy(PAGES_THP);
+                } else if (strcasecmp(optarg, "hugetlb") == 0) {
+                    set_page_policy(PAGES_HUGETLB);
+                } else {
+                    goto invalid;
+                }
+                break;
+
+            default:
+                goto invalid;
+        }
+    }
+
+    if (argc - optind != 2) {
 
         goto invalid;
     }
 
-    g_order = atoll(argv[1]);
-    g_nthreads = atoll(argv[2]);
+    g_order = atoll(argv[optind]);
+    g_nthreads = atoll(argv[optind + 1]);
 
     if (g_order < 1 || g_nthreads < 1) {
         goto invalid;
@@ -116,11 +376,23 @@ void define_settings(int argc, char** argv) {
 
     set_nthreads(g_nthreads);
     set_dimensions(g_order);
+    expr_init(g_order);
+
+    if (strassen >= 0) {
+        set_strassen_threshold(strassen);
+    }
+    if (retain >= 0) {
+        set_retained_limit((size_t) retain << 20);
+    }
+    if (index >= 0) {
+        expr_set_index_limit((size_t) index << 20);
+    }
     return;
 
 invalid:
     puts("Invalid command line arguments");
-    puts("Usage: matrix <width> <# threads>");
+    puts("Usage: matrix <width> <# threads> [--strassen <order>] [--retain <MiB>]"
+         " [--index <MiB>] [--hugepages none|thp|hugetlb] [--batch] [--timing] [--pin]");
     exit(1);
 }
 
@@ -147,6 +419,7 @@ void command_help(void) {
         "SET <key> = random <seed>\n"
         "SET <key> = uniform <value>\n"
         "SET <key> = sequence <start> <step>\n"
+        "SET <key> = load <path>\n"
         "\n"
         "SET <key> = cloned <matrix>\n"
         "SET <key> = reversed <matrix>\n"
@@ -167,21 +440,27 @@ void command_help(void) {
         "COMPUTE trace <key>\n"
         "COMPUTE minimum <key>\n"
         "COMPUTE maximum <key>\n"
-        "COMPUTE frequency <key> <value>\n";
+        "COMPUTE frequency <key> <value>\n"
+        "COMPUTE stats <key> [value]\n"
+        "\n"
+        "SAVE <key> <path>\n"
+        "MEMORY\n"
+        "TIMING on|off\n";
 
     printf("%s", HELP);
 }
 
 /**
- * Set command
+ * Set command, elementwise operations are recorded unevaluated
  */
 void command_set(const char* line) {
 
-    char cmd[MAX_BUFFER];
-    char key[MAX_BUFFER];
-    char func[MAX_BUFFER];
-    char arg1[MAX_BUFFER];
-    char arg2[MAX_BUFFER];
+    char** words = line_words(line);
+    char* cmd = words[0];
+    char* key = words[1];
+    char* func = words[2];
+    char* arg1 = words[3];
+    char* arg2 = words[4];
 
     int argc = sscanf(line, "%s %s = %s %s %s", cmd, key, func, arg1, arg2);
     if (argc < 3) {
@@ -189,12 +468,12 @@ void command_set(const char* line) {
         return;
     }
 
-    uint32_t* matrix = NULL;
+    expr* value = NULL;
 
     switch (argc) {
         case 3:
             if (strcasecmp(func, "identity") == 0) {
-                matrix = identity_matrix();
+                value = expr_identity();
             } else {
                 goto invalid;
             }
@@ -203,19 +482,26 @@ void command_set(const char* line) {
         case 4:
             if (strcasecmp(func, "random") == 0) {
                 uint32_t seed = atoll(arg1);
-                matrix = random_matrix(seed);
+                value = expr_matrix(random_matrix(seed));
             } else if (strcasecmp(func, "uniform") == 0) {
-                uint32_t value = atoll(arg1);
-                matrix = uniform_matrix(value);
+                uint32_t scalar = atoll(arg1);
+                value = expr_uniform(scalar);
+            } else if (strcasecmp(func, "load") == 0) {
+                uint32_t* matrix = load_matrix(arg1);
+                if (matrix == NULL) {
+                    puts("invalid file");
+                    return;
+                }
+                value = expr_matrix(matrix);
             } else if (strcasecmp(func, "cloned") == 0) {
-                MATRIX_GUARD(arg1);
-                matrix = cloned(m);
+                EXPR_GUARD(arg1);
+                value = expr_cloned(e1);
             } else if (strcasecmp(func, "reversed") == 0) {
-                MATRIX_GUARD(arg1);
-                matrix = reversed(m);
+                EXPR_GUARD(arg1);
+                value = expr_reversed(e1);
             } else if (strcasecmp(func, "transposed") == 0) {
-                MATRIX_GUARD(arg1);
-                matrix = transposed(m);
+                EXPR_GUARD(arg1);
+                value = expr_transposed(e1);
             } else {
                 goto invalid;
             }
@@ -225,39 +511,48 @@ void command_set(const char* line) {
             if (strcasecmp(func, "sequence") == 0) {
                 uint32_t start = atoll(arg1);
                 uint32_t step = atoll(arg2);
-                matrix = sequence_matrix(start, step);
+                value = expr_sequence(start, step);
             } else if (strcasecmp(func, "scalar#add") == 0) {
-                MATRIX_GUARD(arg1);
-                uint32_t value = atoll(arg2);
-                matrix = scalar_add(m, value);
+                EXPR_GUARD(arg1);
+                uint32_t scalar = atoll(arg2);
+                value = expr_scalar_add(e1, scalar);
             } else if (strcasecmp(func, "scalar#mul") == 0) {
-                MATRIX_GUARD(arg1);
-                uint32_t value = atoll(arg2);
-                matrix = scalar_mul(m, value);
+                EXPR_GUARD(arg1);
+                uint32_t scalar = atoll(arg2);
+                value = expr_scalar_mul(e1, scalar);
             } else if (strcasecmp(func, "matrix#add") == 0) {
-                MATRIX_GUARD_PAIR(arg1, arg2);
-                matrix = matrix_add(m1, m2);
+                EXPR_GUARD_PAIR(arg1, arg2);
+                value = expr_matrix_add(e1, e2);
             } else if (strcasecmp(func, "matrix#mul") == 0) {
-                MATRIX_GUARD_PAIR(arg1, arg2);
-                matrix = matrix_mul(m1, m2);
+                EXPR_GUARD_PAIR(arg1, arg2);
+                value = expr_matrix_mul(e1, e2);
             } else if (strcasecmp(func, "matrix#pow") == 0) {
-                MATRIX_GUARD(arg1);
+                EXPR_GUARD(arg1);
                 uint32_t exponent = atoll(arg2);
-                matrix = matrix_pow(m, exponent);
+                value = expr_matrix_pow(e1, exponent);
             } else {
                 goto invalid;
             }
             break;
     }
 
+    /* a clone shares the value of its source, and so its statistics */
+    entry cache = { .cached = 0 };
+    if (strcasecmp(func, "cloned") == 0) {
+        cache = *find_entry(arg1);
+    }
+
     entry* e = find_entry(key);
     if (e == NULL) {
         e = add_entry(key);
     } else {
-        free(e->matrix);
+        expr_release(e->value);
     }
 
-    e->matrix = matrix;
+    e->value = value;
+    e->cached = cache.cached;
+    e->counted = cache.counted;
+    e->stats = cache.stats;
 
     puts("ok");
     return;
@@ -271,11 +566,12 @@ invalid:
  */
 void command_show(char* line) {
 
-    char cmd[MAX_BUFFER];
-    char key[MAX_BUFFER];
-    char func[MAX_BUFFER];
-    char arg1[MAX_BUFFER];
-    char arg2[MAX_BUFFER];
+    char** words = line_words(line);
+    char* cmd = words[0];
+    char* key = words[1];
+    char* func = words[2];
+    char* arg1 = words[3];
+    char* arg2 = words[4];
 
     int argc = sscanf(line, "%s %s %s %s %s", cmd, key, func, arg1, arg2);
     if (argc < 2) {
@@ -312,62 +608,283 @@ invalid:
 }
 
 /**
- * Compute command
+ * Returns the statistics of e, computing all of them with the frequency
+ * of value unless they are cached
+ */
+static const struct matrix_stats* entry_stats(entry* e, uint32_t value) {
+
+    if ((e->cached & STAT_ALL) != STAT_ALL || !(e->cached & STAT_FREQUENCY) || e->counted != value) {
+        e->stats = expr_stats(e->value, value);
+        e->counted = value;
+        e->cached = STAT_ALL | STAT_FREQUENCY;
+    }
+
+    return &e->stats;
+}
+
+/**
+ * Returns one statistic of e, computing it unless it is cached
+ */
+static uint32_t entry_stat(entry* e, unsigned stat, uint32_t value) {
+
+    struct matrix_stats* stats = &e->stats;
+    const bool cached = (e->cached & stat) && (stat != STAT_FREQUENCY || e->counted == value);
+
+    if (!cached) {
+        switch (stat) {
+            case STAT_SUM:
+                stats->sum = expr_sum(e->value);
+                break;
+            case STAT_TRACE:
+                stats->trace = expr_trace(e->value);
+                break;
+            case STAT_MINIMUM:
+                stats->minimum = expr_minimum(e->value);
+                break;
+            case STAT_MAXIMUM:
+                stats->maximum = expr_maximum(e->value);
+                break;
+            default:
+                stats->frequency = expr_frequency(e->value, value);
+                e->counted = value;
+                break;
+        }
+        e->cached |= stat;
+    }
+
+    switch (stat) {
+        case STAT_SUM:
+            return stats->sum;
+        case STAT_TRACE:
+            return stats->trace;
+        case STAT_MINIMUM:
+            return stats->minimum;
+        case STAT_MAXIMUM:
+            return stats->maximum;
+        default:
+            return stats->frequency;
+    }
+}
+
+/**
+ * Compute command, statistics are cached per entry until it is set again
  */
 void command_compute(char* line) {
 
-    char cmd[MAX_BUFFER];
-    char key[MAX_BUFFER];
-    char func[MAX_BUFFER];
-    char arg1[MAX_BUFFER];
+    char** words = line_words(line);
+    char* cmd = words[0];
+    char* key = words[1];
+    char* func = words[2];
+    char* arg1 = words[3];
 
     int argc = sscanf(line, "%s %s %s %s", cmd, func, key, arg1);
     if (argc < 3) {
         goto invalid;
     }
 
-    MATRIX_GUARD(key);
-    uint32_t result = 0;
+    entry* e = find_entry(key);
+    if (e == NULL) {
+        puts("no such matrix");
+        return;
+    }
+
+    const uint32_t value = argc == 4 ? atoll(arg1) : 0;
+    unsigned stat;
+
+    if (strcasecmp(func, "stats") == 0) {
+        const struct matrix_stats* stats = entry_stats(e, value);
+
+        printf("sum %" PRIu32 "\n", stats->sum);
+        printf("trace %" PRIu32 "\n", stats->trace);
+        printf("minimum %" PRIu32 "\n", stats->minimum);
+        printf("maximum %" PRIu32 "\n", stats->maximum);
+        if (argc == 4) {
+            printf("frequency %" PRIu32 "\n", stats->frequency);
+        }
+        return;
+    }
 
     if (strcasecmp(func, "sum") == 0) {
-        result = get_sum(m);
+        stat = STAT_SUM;
     } else if (strcasecmp(func, "trace") == 0) {
-        result = get_trace(m);
+        stat = STAT_TRACE;
     } else if (strcasecmp(func, "minimum") == 0) {
-        result = get_minimum(m);
+        stat = STAT_MINIMUM;
     } else if (strcasecmp(func, "maximum") == 0) {
-        result = get_maximum(m);
+        stat = STAT_MAXIMUM;
     } else if (strcasecmp(func, "frequency") == 0) {
-        result = get_frequency(m, atoll(arg1));
+        stat = STAT_FREQUENCY;
     } else {
         goto invalid;
     }
 
-    printf("%" PRIu32 "\n", result);
+    printf("%" PRIu32 "\n", entry_stat(e, stat, value));
     return;
 
 invalid:
     puts("invalid arguments");
 }
 
+/**
+ * Save command
+ */
+void command_save(const char* line) {
+
+    char** words = line_words(line);
+    char* cmd = words[0];
+    char* key = words[1];
+    char* path = words[2];
+
+    int argc = sscanf(line, "%s %s %s", cmd, key, path);
+    if (argc != 3) {
+        puts("invalid arguments");
+        return;
+    }
+
+    MATRIX_GUARD(key);
+    if (save_matrix(m, path)) {
+        puts("ok");
+    } else {
+        puts("invalid file");
+    }
+}
+
+static int compare_entries(const void* a, const void* b) {
+
+    return strcmp((*(const entry* const*) a)->key, (*(const entry* const*) b)->key);
+}
+
+/**
+ * Memory command, lists the storage and huge pages behind each key, and
+ * whether frequency queries on it are indexed or it is over --index
+ */
+void command_memory(void) {
+
+    if (g_nentries == 0) {
+        return;
+    }
+
+    entry** sorted = malloc(g_nentries * sizeof(entry*));
+    if (!sorted) {
+        perror("malloc");
+        exit(1);
+    }
+
+    ssize_t count = 0;
+    for (ssize_t i = 0; i < g_capacity; i++) {
+        if (g_entries[i].key != NULL) {
+            sorted[count++] = g_entries + i;
+        }
+    }
+
+    qsort(sorted, count, sizeof(entry*), compare_entries);
+
+    for (ssize_t i = 0; i < count; i++) {
+        const uint32_t* matrix = expr_value(sorted[i]->value);
+
+        if (matrix == NULL) {
+            printf("%s unevaluated\n", sorted[i]->key);
+        } else {
+            printf("%s %zd bytes %zu huge pages%s\n", sorted[i]->key,
+                   g_order * g_order * (ssize_t) sizeof(uint32_t), huge_pages(matrix),
+                   expr_indexed(sorted[i]->value) ? " indexed" :
+                   !expr_indexable() ? " too large to index" : "");
+        }
+    }
+
+    free(sorted);
+}
+
+/**
+ * Timing command, turns the report after each matrix command on or off
+ */
+void command_timing(const char* line) {
+
+    char** words = line_words(line);
+    char* cmd = words[0];
+    char* state = words[1];
+
+    int argc = sscanf(line, "%s %s", cmd, state);
+    if (argc == 2 && strcasecmp(state, "on") == 0) {
+        g_timing = true;
+    } else if (argc == 2 && strcasecmp(state, "off") == 0) {
+        g_timing = false;
+    } else {
+        puts("invalid arguments");
+        return;
+    }
+
+    puts("ok");
+}
+
+struct timing {
+    struct timespec wall;
+    struct timespec cpu;
+    struct matrix_traffic traffic;
+};
+
+static double elapsed(const struct timespec* start, const struct timespec* end) {
+
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/**
+ * Records the clocks and traffic before a command
+ */
+static void timing_start(struct timing* timing) {
+
+    clock_gettime(CLOCK_MONOTONIC, &timing->wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timing->cpu);
+    timing->traffic = get_traffic();
+}
+
+/**
+ * Prints the wall and CPU time, over all threads, and the traffic of the
+ * command since timing_start
+ */
+static void timing_report(const struct timing* start) {
+
+    struct timing end;
+    timing_start(&end);
+
+    const double wall = elapsed(&start->wall, &end.wall);
+    const double cpu = elapsed(&start->cpu, &end.cpu);
+    const uint64_t read = end.traffic.read - start->traffic.read;
+    const uint64_t written = end.traffic.written - start->traffic.written;
+    const uint64_t ops = end.traffic.ops - start->traffic.ops;
+
+    printf("time %.3f ms wall %.3f ms cpu, %" PRIu64 " bytes read %" PRIu64 " bytes written,"
+           " %.3f GB/s %.3f GOP/s\n", wall * 1e3, cpu * 1e3, read, written,
+           wall > 0 ? (read + written) / wall * 1e-9 : 0, wall > 0 ? ops / wall * 1e-9 : 0);
+}
+
 /**
  * Runs computations and stores matrices based on given input
  */
 void compute_engine(void) {
 
-    g_entries = calloc(MAX_ENTRIES, sizeof(entry*));
+    resize_entries(MIN_CAPACITY);
+
+    /* batch responses go out in large writes through stdio's buffer */
+    if (g_batch) {
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    }
 
     while (true) {
-        printf("> ");
+        if (!g_batch) {
+            printf("> ");
+        }
 
-        char line[MAX_BUFFER];
-        if (fgets(line, MAX_BUFFER, stdin) == NULL) {
+        char* line = read_line();
+        if (line == NULL) {
             command_bye();
         }
 
-        char command[MAX_BUFFER];
+        char* command = line_words(line)[0];
         if (sscanf(line, "%s", command) != 1) {
-            printf("\n");
+            if (!g_batch) {
+                printf("\n");
+            }
             continue;
         }
 
@@ -375,17 +892,36 @@ void compute_engine(void) {
             command_bye();
         } else if (strcasecmp(command, "help") == 0) {
             command_help();
-        } else if (strcasecmp(command, "set") == 0) {
-            command_set(line);
-        } else if (strcasecmp(command, "show") == 0) {
-            command_show(line);
-        } else if (strcasecmp(command, "compute") == 0) {
-            command_compute(line);
+        } else if (strcasecmp(command, "memory") == 0) {
+            command_memory();
+        } else if (strcasecmp(command, "timing") == 0) {
+            command_timing(line);
         } else {
-            puts("invalid command");
+            struct timing timing;
+            bool timed = true;
+            timing_start(&timing);
+
+            if (strcasecmp(command, "set") == 0) {
+                command_set(line);
+            } else if (strcasecmp(command, "show") == 0) {
+                command_show(line);
+            } else if (strcasecmp(command, "compute") == 0) {
+                command_compute(line);
+            } else if (strcasecmp(command, "save") == 0) {
+                command_save(line);
+            } else {
+                puts("invalid command");
+                timed = false;
+            }
+
+            if (g_timing && timed) {
+                timing_report(&timing);
+            }
         }
 
-        printf("\n");
+        if (!g_batch) {
+            printf("\n");
+        }
     }
 }
 
@@ -3,30 +3,44 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <stdbool.h>
-#include <pthread.h>
 #include <inttypes.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "matrix.h"
+#include "buffer.h"
+#include "format.h"
+#include "pool.h"
+#include "gemm.h"
+#include "simd.h"
+#include "strassen.h"
 
-static uint32_t g_seed = 0;
+static __thread uint32_t t_seed = 0;
 
 static ssize_t g_width = 0;
 static ssize_t g_height = 0;
 static ssize_t g_elements = 0;
 
 static ssize_t g_nthreads = 1;
+static ssize_t g_strassen = 4096;
+
+/* only updated by the calling thread, outside of parallel regions */
+static struct matrix_traffic g_traffic = { 0 };
+
 #define  CELL(x,y) ((y) * g_width + (x))
 
+/* elements per chunk handed out by the work-stealing loops */
+#define MATRIX_GRAIN (1 << 14)
+
 struct matrix_add {
     uint32_t* matrix;
     uint32_t scalar;
-    uint32_t tid;
 };
 struct matrix_scalar_mul {
     
     uint32_t* result;
     const uint32_t* matrix;
-    uint32_t tid;
     uint32_t scalar;
 
 };
@@ -34,7 +48,6 @@ struct matrix_scalar_mul {
 struct matrix_trace {
    const  uint32_t* matrix;
     uint32_t scalar;
-    uint32_t tid;
     
 
 };
@@ -44,7 +57,6 @@ struct matrix_addition {
     const uint32_t* matrix_a;
     const uint32_t* matrix_b;
     uint32_t*  result;
-    uint32_t tid;
 
 };
 
@@ -57,24 +69,83 @@ struct matrix_addition {
  */
 uint32_t fast_rand(void) {
 
-    g_seed = (214013 * g_seed + 2531011);
-    return (g_seed >> 16) & 0x7FFF;
+    t_seed = SIMD_RAND_MULTIPLIER * t_seed + SIMD_RAND_INCREMENT;
+    return (t_seed >> 16) & 0x7FFF;
 }
 
 /**
- * Sets the seed used when generating pseudorandom numbers
+ * Sets the seed used by the calling thread when generating pseudorandom
+ * numbers
  */
 void set_seed(uint32_t seed) {
 
-    g_seed = seed;
+    t_seed = seed;
+}
+
+/**
+ * Returns the generator state the given number of steps after state. Each
+ * step is the affine map x -> ax + c, so k steps compose in O(log k) by
+ * repeated squaring.
+ */
+static uint32_t jump_seed(uint32_t state, uint64_t steps) {
+
+    uint32_t a = SIMD_RAND_MULTIPLIER, c = SIMD_RAND_INCREMENT;
+    uint32_t jump_a = 1, jump_c = 0;
+
+    while (steps > 0) {
+        if (steps & 1) {
+            jump_a = a * jump_a;
+            jump_c = a * jump_c + c;
+        }
+        c = a * c + c;
+        a = a * a;
+        steps >>= 1;
+    }
+
+    return jump_a * state + jump_c;
+}
+
+/**
+ * Records bytes read and written and operations performed on behalf of
+ * the current command
+ */
+void add_traffic(uint64_t read, uint64_t written, uint64_t ops) {
+
+    g_traffic.read += read;
+    g_traffic.written += written;
+    g_traffic.ops += ops;
+}
+
+/**
+ * Returns the traffic recorded since the program started
+ */
+struct matrix_traffic get_traffic(void) {
+
+    return g_traffic;
 }
 
 /**
- * Sets the number of threads available
+ * Sets the number of threads available and starts the worker pool
  */
 void set_nthreads(ssize_t count) {
 
     g_nthreads = count;
+    pool_init(count);
+    simd_init();
+    gemm_init(count);
+}
+
+/**
+ * Sets whether worker threads are pinned to CPUs, grouped by socket.
+ * Pinned, every operation partitions by tid the same way, without work
+ * stealing, so a fresh result is first written by the thread owning each
+ * slice and a pinned thread finds its slices on its own node. Buffers
+ * recycled from the pool keep the placement of their first use. Takes
+ * effect at the next set_nthreads.
+ */
+void set_pinning(bool pin) {
+
+    pool_set_pinning(pin);
 }
 
 /**
@@ -89,18 +160,94 @@ void set_dimensions(ssize_t order) {
 }
 
 /**
- * Displays given matrix
+ * Sets the smallest order multiplied with Strassen-Winograd (0 disables it)
  */
-void display(const uint32_t* matrix) {
+void set_strassen_threshold(ssize_t order) {
+
+    g_strassen = order;
+}
+
+/**
+ * Displays given matrix. Rows are formatted in chunks of up to
+ * DISPLAY_CHUNK bytes, one batch of chunks in parallel at a time, and
+ * each batch is written out in order. Chunks shrink with more threads so
+ * a batch never holds more than DISPLAY_BATCH bytes.
+ */
+
+#define DISPLAY_CHUNK (1 << 20)
+#define DISPLAY_BATCH (16 << 20)
+
+struct matrix_display {
+    const uint32_t* matrix;
+    char* buffers;
+    struct iovec* iov;
+    size_t capacity;
+    ssize_t rows;
+    ssize_t first;
+};
+
+static void display_worker(void* arg, ssize_t start, ssize_t end) {
+
+    struct matrix_display* display = (struct matrix_display*) arg;
+
+    for (ssize_t chunk = start; chunk < end; chunk++) {
+        const ssize_t first = (display->first + chunk) * display->rows;
+        const ssize_t last = first + display->rows < g_height ? first + display->rows : g_height;
 
-    for (ssize_t y = 0; y < g_height; y++) {
-        for (ssize_t x = 0; x < g_width; x++) {
-            if (x > 0) printf(" ");
-            printf("%" PRIu32, matrix[y * g_width + x]);
+        char* out = display->buffers + chunk * display->capacity;
+        char* p = out;
+
+        for (ssize_t y = first; y < last; y++) {
+            p = format_values(p, display->matrix + y * g_width, g_width, 1, ' ', '\n');
         }
 
-        printf("\n");
+        display->iov[chunk].iov_base = out;
+        display->iov[chunk].iov_len = p - out;
+    }
+}
+
+void display(const uint32_t* matrix) {
+
+    const size_t row_bytes = g_width * (FORMAT_U32_MAX + 1);
+    const size_t chunk_bytes = DISPLAY_BATCH / pool_size() < DISPLAY_CHUNK ?
+                               DISPLAY_BATCH / pool_size() : DISPLAY_CHUNK;
+    const ssize_t rows = row_bytes >= chunk_bytes ? 1 : chunk_bytes / row_bytes;
+    const ssize_t chunks = (g_height + rows - 1) / rows;
+
+    /* single rows longer than a chunk are still bounded by the batch */
+    const ssize_t fit = rows * row_bytes > DISPLAY_BATCH ? 1 : DISPLAY_BATCH / (rows * row_bytes);
+    ssize_t batch = chunks < pool_size() ? chunks : pool_size();
+    batch = batch < fit ? batch : fit;
+
+    struct matrix_display m_display = {
+        .matrix = matrix,
+        .buffers = malloc(batch * rows * row_bytes),
+        .iov = malloc(batch * sizeof(struct iovec)),
+        .capacity = rows * row_bytes,
+        .rows = rows
+    };
+
+    if (!m_display.buffers || !m_display.iov) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (ssize_t first = 0; first < chunks; first += batch) {
+        const ssize_t count = chunks - first < batch ? chunks - first : batch;
+
+        m_display.first = first;
+        pool_for(display_worker, &m_display, count);
+        format_writev(m_display.iov, count);
+
+        for (ssize_t i = 0; i < count; i++) {
+            add_traffic(0, m_display.iov[i].iov_len, 0);
+        }
     }
+
+    add_traffic(g_elements * sizeof(uint32_t), 0, g_elements);
+
+    free(m_display.buffers);
+    free(m_display.iov);
 }
 
 /**
@@ -108,12 +255,17 @@ void display(const uint32_t* matrix) {
  */
 void display_row(const uint32_t* matrix, ssize_t row) {
 
-    for (ssize_t x = 0; x < g_width; x++) {
-        if (x > 0) printf(" ");
-        printf("%" PRIu32, matrix[row * g_width + x]);
+    char* out = malloc(g_width * (FORMAT_U32_MAX + 1));
+    if (!out) {
+        perror("malloc");
+        exit(1);
     }
 
-    printf("\n");
+    char* end = format_values(out, matrix + row * g_width, g_width, 1, ' ', '\n');
+    format_write(out, end - out);
+    add_traffic(g_width * sizeof(uint32_t), end - out, g_width);
+
+    free(out);
 }
 
 /**
@@ -121,9 +273,17 @@ void display_row(const uint32_t* matrix, ssize_t row) {
  */
 void display_column(const uint32_t* matrix, ssize_t column) {
 
-    for (ssize_t y = 0; y < g_height; y++) {
-        printf("%" PRIu32 "\n", matrix[y * g_width + column]);
+    char* out = malloc(g_height * (FORMAT_U32_MAX + 1));
+    if (!out) {
+        perror("malloc");
+        exit(1);
     }
+
+    char* end = format_values(out, matrix + column, g_height, g_width, '\n', '\n');
+    format_write(out, end - out);
+    add_traffic(g_height * sizeof(uint32_t), end - out, g_height);
+
+    free(out);
 }
 
 /**
@@ -131,123 +291,197 @@ void display_column(const uint32_t* matrix, ssize_t column) {
  */
 void display_element(const uint32_t* matrix, ssize_t row, ssize_t column) {
 
-    printf("%" PRIu32 "\n", matrix[row * g_width + column]);
+    const int written = printf("%" PRIu32 "\n", matrix[row * g_width + column]);
+    add_traffic(sizeof(uint32_t), written, 1);
 }
 
 ////////////////////////////////
 ///   MATRIX INITALISATIONS  ///
 ////////////////////////////////
 
+/**
+ * Returns new matrix with uninitialised elements, for results that
+ * overwrite every element
+ */
+uint32_t* alloc_matrix(void) {
+
+    return buffer_alloc(g_elements * sizeof(uint32_t));
+}
+
+/**
+ * Returns a matrix to the buffer pool
+ */
+void release_matrix(uint32_t* matrix) {
+
+    buffer_free(matrix);
+}
+
+/**
+ * Sets how many bytes of released matrices are kept for reuse
+ */
+void set_retained_limit(size_t bytes) {
+
+    buffer_set_limit(bytes);
+}
+
+/**
+ * Sets how large matrices are backed: by the system default, advised
+ * transparent huge pages or reserved hugetlb pages
+ */
+void set_page_policy(enum page_policy policy) {
+
+    switch (policy) {
+        case PAGES_THP:
+            buffer_set_pages(BUFFER_PAGES_THP);
+            break;
+        case PAGES_HUGETLB:
+            buffer_set_pages(BUFFER_PAGES_HUGETLB);
+            break;
+        default:
+            buffer_set_pages(BUFFER_PAGES_DEFAULT);
+            break;
+    }
+}
+
+/**
+ * Returns how many huge pages currently back given matrix
+ */
+size_t huge_pages(const uint32_t* matrix) {
+
+    return buffer_huge_pages(matrix);
+}
+
 /**
  * Returns new matrix with all elements set to zero
  */
+
+static void zero_worker(void* arg, ssize_t start, ssize_t end) {
+
+    simd_fill((uint32_t*) arg + start, 0, end - start);
+}
+
 uint32_t* new_matrix(void) {
 
-    return calloc(g_elements, sizeof(uint32_t));
+    uint32_t* result = alloc_matrix();
+    pool_steal(zero_worker, result, g_elements, MATRIX_GRAIN);
+    add_traffic(0, g_elements * sizeof(uint32_t), 0);
+
+    return result;
 }
 
 /**
- * Returns new identity matrix
+ * Returns new identity matrix, zeroing and setting the diagonal row by
+ * row so each thread first touches its own rows
  */
-uint32_t* identity_matrix(void) {
 
-    uint32_t* matrix = new_matrix();
-    const int width = g_width;
+static void identity_worker(void* arg, ssize_t start, ssize_t end) {
+
+    uint32_t* matrix = (uint32_t*) arg;
 
-    for (ssize_t i = 0; i < width; i++) {
-        matrix[i * width + i] = 1;
+    simd_fill(matrix + start * g_width, 0, (end - start) * g_width);
+    for (ssize_t row = start; row < end; row++) {
+        matrix[CELL(row, row)] = 1;
     }
+}
+
+uint32_t* identity_matrix(void) {
+
+    uint32_t* result = alloc_matrix();
+    pool_steal(identity_worker, result, g_height, MATRIX_GRAIN / g_width + 1);
+    add_traffic(0, g_elements * sizeof(uint32_t), 0);
 
-    return matrix;
+    return result;
 }
 
 /**
- * Returns new matrix with elements generated at random using given seed
+ * Returns new matrix with elements generated at random using given seed,
+ * the same as calling fast_rand once per element. Each thread jumps the
+ * generator to the start of its range, and the calling thread's seed is
+ * left where the serial loop would have left it.
  */
+
+static void random_worker(void* arg, ssize_t start, ssize_t end) {
+
+    struct matrix_add* matrix = (struct matrix_add*) arg;
+
+    simd_random(matrix->matrix + start, jump_seed(matrix->scalar, start), end - start);
+}
+
 uint32_t* random_matrix(uint32_t seed) {
 
-    uint32_t* matrix = new_matrix();
-    const int noElement =  g_elements;
-    set_seed(seed);
+    uint32_t* result = alloc_matrix();
 
-    for (ssize_t i = 0; i < noElement; i++) {
-        matrix[i] = fast_rand();
-    }
+    struct matrix_add m_add = {
+        .matrix = result,
+        .scalar = seed
+    };
+
+    pool_steal(random_worker, &m_add, g_elements, MATRIX_GRAIN);
+    set_seed(jump_seed(seed, g_elements));
+    add_traffic(0, g_elements * sizeof(uint32_t), g_elements);
 
-    return matrix;
+    return result;
 }
 
 /**
  * Returns new matrix with all elements set to given value
  */
 
-static void *uniform_worker(void* arg) {
+static void uniform_worker(void* arg, ssize_t start, ssize_t end) {
     
     struct matrix_add *matrix = (struct matrix_add *) arg;
-    
-    const size_t start = matrix->tid * g_elements / g_nthreads;
-    const size_t end = matrix->tid == g_nthreads - 1 ? g_elements : (matrix->tid + 1) * g_elements / g_nthreads;
-
-    for(size_t i = start; i < end; i++) {
-        matrix->matrix[i] = matrix->scalar;
-    }
-
-    return NULL;
 
+    simd_fill(matrix->matrix + start, matrix->scalar, end - start);
 }
 
 uint32_t* uniform_matrix(uint32_t value) {
 
-    uint32_t* result = new_matrix();
-    const int threads = g_nthreads;
-    pthread_t thread_id[threads];
-
-    struct matrix_add *m_add = malloc(sizeof(struct matrix_add) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return result;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_add) {
-            .matrix = result,
-            .tid = i,
-            .scalar = value
-        };
-    }
-
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, uniform_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return result;
-        }
-    }
+    uint32_t* result = alloc_matrix();
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return result;
-        }
-    }
+    struct matrix_add m_add = {
+        .matrix = result,
+        .scalar = value
+    };
 
-    free(m_add);
+    pool_steal(uniform_worker, &m_add, g_elements, MATRIX_GRAIN);
+    add_traffic(0, g_elements * sizeof(uint32_t), 0);
 
     return result;
 }
 
 /**
- * Returns new matrix with elements in sequence from given start and step
+ * Returns new matrix with elements in sequence from given start and step,
+ * element i being start + i * step
  */
+
+struct matrix_sequence {
+    uint32_t* matrix;
+    uint32_t start;
+    uint32_t step;
+};
+
+static void sequence_worker(void* arg, ssize_t start, ssize_t end) {
+
+    struct matrix_sequence* matrix = (struct matrix_sequence*) arg;
+
+    simd_sequence(matrix->matrix + start, matrix->start + (uint32_t) start * matrix->step,
+                  matrix->step, end - start);
+}
+
 uint32_t* sequence_matrix(uint32_t start, uint32_t step) {
 
-    uint32_t* matrix = new_matrix();
-    uint32_t current = start;
-    const int noElements = g_elements;
-    for (ssize_t i = 0; i < noElements; i++) {
-        matrix[i] = current;
-        current += step;
-    }
+    uint32_t* result = alloc_matrix();
+
+    struct matrix_sequence m_add = {
+        .matrix = result,
+        .start = start,
+        .step = step
+    };
+
+    pool_steal(sequence_worker, &m_add, g_elements, MATRIX_GRAIN);
+    add_traffic(0, g_elements * sizeof(uint32_t), g_elements);
 
-    return matrix;
+    return result;
 }
 
 ////////////////////////////////
@@ -259,75 +493,59 @@ uint32_t* sequence_matrix(uint32_t start, uint32_t step) {
  */
 
 struct matrix_clone {
-    uint32_t tid;
     const uint32_t* toClone;
     uint32_t* result;
 };
 
-static void* clone_worker(void* arg) {
+static void clone_worker(void* arg, ssize_t start, ssize_t end) {
 
     struct matrix_clone* matrix = (struct matrix_clone*) arg;
-    const size_t start = matrix->tid * g_elements / g_nthreads;
-    const size_t end = matrix->tid == g_nthreads - 1 ? g_elements : (matrix->tid + 1) * g_elements / g_nthreads;
-    
-
-    for(size_t i = start; i < end;i++) {
-       matrix->result[i] = matrix->toClone[i];
-    }
-
-    return NULL;
 
+    simd_copy(matrix->result + start, matrix->toClone + start, end - start);
 }
 
 
 uint32_t* cloned(const uint32_t* matrix) {
-    const int threads = g_nthreads;
-    pthread_t thread_id[threads];
-    uint32_t* result = new_matrix();
-
-    struct matrix_clone *m_add = malloc(sizeof(struct matrix_clone) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return result;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_clone) {
-            .toClone = matrix,
-            .tid = i,
-            .result = result
-        };
-    }
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, clone_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return result;
-        }
-    }
+    uint32_t* result = alloc_matrix();
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return result;
-        }
-    }
+    struct matrix_clone m_add = {
+        .toClone = matrix,
+        .result = result
+    };
 
-    free(m_add);
+    pool_steal(clone_worker, &m_add, g_elements, MATRIX_GRAIN);
+    add_traffic(g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), 0);
 
     return result;
     
 }
 
 /**
- * Returns new matrix with elements ordered in reverse
+ * Returns new matrix with elements ordered in reverse, each thread
+ * writing its own slice of the result
  */
-uint32_t* reversed(const uint32_t* matrix) {
 
-    uint32_t* result = new_matrix();
-    const int noElements = g_elements;
-    for (ssize_t i = 0; i < noElements; i++) {
-        result[i] = matrix[g_elements - 1 - i];
+static void reverse_worker(void* arg, ssize_t start, ssize_t end) {
+
+    struct matrix_clone* matrix = (struct matrix_clone*) arg;
+
+    for (ssize_t i = start; i < end; i++) {
+        matrix->result[i] = matrix->toClone[g_elements - 1 - i];
     }
+}
+
+uint32_t* reversed(const uint32_t* matrix) {
+
+    uint32_t* result = alloc_matrix();
+
+    struct matrix_clone m_add = {
+        .toClone = matrix,
+        .result = result
+    };
+
+    pool_steal(reverse_worker, &m_add, g_elements, MATRIX_GRAIN);
+    add_traffic(g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), 0);
 
     return result;
 }
@@ -335,52 +553,64 @@ uint32_t* reversed(const uint32_t* matrix) {
 /**
  * Returns new transposed matrix
  */
-uint32_t* transposed(const uint32_t* matrix) {
 
-    uint32_t* result = new_matrix();
+#define TRANSPOSE_BLOCK 64
 
-    for (ssize_t y = 0; y < g_height; y++) {
-        for (ssize_t x = 0; x < g_width; x++) {
-            result[x * g_width + y] = matrix[y * g_width + x];
-        }
+struct matrix_transpose {
+    const uint32_t* matrix;
+    uint32_t* result;
+    ssize_t blocks;
+};
+
+/*
+ * Block t covers result rows (t / blocks) and columns (t % blocks), so
+ * each thread writes a contiguous run of result rows
+ */
+static void transpose_worker(void* arg, ssize_t start, ssize_t end) {
+
+    struct matrix_transpose* matrix = (struct matrix_transpose*) arg;
+
+    for (ssize_t t = start; t < end; t++) {
+        const ssize_t x = (t / matrix->blocks) * TRANSPOSE_BLOCK;
+        const ssize_t y = (t % matrix->blocks) * TRANSPOSE_BLOCK;
+        const ssize_t cols = g_width - x < TRANSPOSE_BLOCK ? g_width - x : TRANSPOSE_BLOCK;
+        const ssize_t rows = g_height - y < TRANSPOSE_BLOCK ? g_height - y : TRANSPOSE_BLOCK;
+
+        simd_transpose(matrix->result + CELL(y, x), g_height, matrix->matrix + CELL(x, y), g_width, rows, cols);
     }
+}
+
+uint32_t* transposed(const uint32_t* matrix) {
+
+    uint32_t* result = alloc_matrix();
+    const ssize_t blocks = (g_width + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK;
+
+    struct matrix_transpose m_add = {
+        .matrix = matrix,
+        .result = result,
+        .blocks = blocks
+    };
+
+    pool_steal(transpose_worker, &m_add, blocks * blocks, 1);
+    add_traffic(g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), 0);
 
     return result;
 }
 
 
 
-static void *scalar_worker(void *arg) {
+static void scalar_worker(void *arg, ssize_t start, ssize_t end) {
+
     struct matrix_scalar_mul *matrix = (struct matrix_scalar_mul *) arg;
-    const int elements = g_elements;
-    const int threads = g_nthreads;
-    const size_t start = matrix->tid * elements / threads;
-    const size_t end = matrix->tid == threads - 1 ? elements : (matrix->tid + 1) * elements / threads;   
-  
-
-    for(size_t i = start; i < end; i++) {
-        matrix->result[i] = matrix->matrix[i] + matrix->scalar;
-    }
 
-    return NULL;
+    simd_add_scalar(matrix->result + start, matrix->matrix + start, matrix->scalar, end - start);
 }
 
-static void *multiply_worker(void *arg) {
+static void multiply_worker(void *arg, ssize_t start, ssize_t end) {
     
     struct matrix_scalar_mul *matrix = (struct matrix_scalar_mul *) arg;
-     const int elements = g_elements;
-    const int threads = g_nthreads;
-    const size_t start = matrix->tid * elements / threads;
-    const size_t end = matrix->tid == threads - 1 ? elements : (matrix->tid + 1) * elements / threads;  
-
-
-    for(size_t i = start; i < end; i++) {
-        matrix->result[i] = matrix->matrix[i] * matrix->scalar; 
-    }
-
-    return NULL;
-
 
+    simd_mul_scalar(matrix->result + start, matrix->matrix + start, matrix->scalar, end - start);
 }
 
 /**
@@ -389,39 +619,16 @@ static void *multiply_worker(void *arg) {
 uint32_t* scalar_add(const uint32_t* matrix, uint32_t scalar) {
 
 
-    uint32_t* result = new_matrix();
-    const int threads = g_nthreads;
-   
-    pthread_t thread_id[threads];
-
-    struct matrix_scalar_mul  *m_add = malloc(sizeof(struct matrix_scalar_mul) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return result;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_scalar_mul) {
-            .matrix = matrix,
-            .result = result,
-            .tid = i,
-            .scalar = scalar
-        };
-    }
+    uint32_t* result = alloc_matrix();
 
-    for(int i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, scalar_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return result;
-        }
-    }
+    struct matrix_scalar_mul m_add = {
+        .matrix = matrix,
+        .result = result,
+        .scalar = scalar
+    };
 
-    for(int i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return result;
-        }
-    }
-    free(m_add);
+    pool_steal(scalar_worker, &m_add, g_elements, MATRIX_GRAIN);
+    add_traffic(g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), g_elements);
     
     return result;
     
@@ -442,39 +649,17 @@ uint32_t* scalar_add(const uint32_t* matrix, uint32_t scalar) {
 
 uint32_t* scalar_mul(const uint32_t* matrix, uint32_t scalar) {
 
-    uint32_t* result = new_matrix();
-
-    const int threads = g_nthreads; 
-    pthread_t thread_id[threads];
+    uint32_t* result = alloc_matrix();
 
-    struct matrix_scalar_mul  *m_add = malloc(sizeof(struct matrix_scalar_mul) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return result;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_scalar_mul) {
-            .matrix = matrix,
-            .result = result,
-            .tid = i,
-            .scalar = scalar
-        };
-    }
+    struct matrix_scalar_mul m_add = {
+        .matrix = matrix,
+        .result = result,
+        .scalar = scalar
+    };
 
-    for(int i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, multiply_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return result;
-        }
-    }
+    pool_steal(multiply_worker, &m_add, g_elements, MATRIX_GRAIN);
+    add_traffic(g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), g_elements);
 
-    for(int i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return result;
-        }
-    }
-    free(m_add);
     return result;
     /*
         to do
@@ -492,59 +677,24 @@ uint32_t* scalar_mul(const uint32_t* matrix, uint32_t scalar) {
  * Returns new matrix with elements added at the same index
  */
 
-void* matrix_addition_worker (void* arg) {
+static void matrix_addition_worker(void* arg, ssize_t start, ssize_t end) {
     
     struct matrix_addition *matrix = (struct matrix_addition *) arg;
-    const int elements = g_elements;
-    const int threads = g_nthreads;
-    const size_t start = matrix->tid * elements / threads;
-    const size_t end = matrix->tid == threads - 1 ? elements : (matrix->tid + 1) * elements / threads; 
-   
-
-    for(size_t i = start; i < end; i++) {
-        matrix->result[i] = matrix->matrix_a[i] +  matrix->matrix_b[i];
-    }
-
-    return NULL;
-    
 
+    simd_add(matrix->result + start, matrix->matrix_a + start, matrix->matrix_b + start, end - start);
 }
 uint32_t* matrix_add(const uint32_t* matrix_a, const uint32_t* matrix_b) {
     
-    uint32_t* result = new_matrix();
-    const int threads = g_nthreads;
-    
-    pthread_t thread_id[threads];
+    uint32_t* result = alloc_matrix();
 
-    struct matrix_addition  *m_add = malloc(sizeof(struct matrix_addition) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return result;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_addition) {
-            .matrix_a = matrix_a,
-            .matrix_b = matrix_b,
-            .result = result,
-            .tid = i
-        };
-    }
-
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, matrix_addition_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return result;
-        }
-    }
+    struct matrix_addition m_add = {
+        .matrix_a = matrix_a,
+        .matrix_b = matrix_b,
+        .result = result
+    };
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return result;
-        }
-    }
-    free(m_add);
-    
+    pool_steal(matrix_addition_worker, &m_add, g_elements, MATRIX_GRAIN);
+    add_traffic(2 * g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), g_elements);
 
     return result;
 
@@ -565,226 +715,88 @@ uint32_t* matrix_add(const uint32_t* matrix_a, const uint32_t* matrix_b) {
  * Returns new matrix, multiplying the two matrices together
  */
 
+/* products are counted at the 2n^3 operations of the classical algorithm */
+static void add_product(void) {
 
-struct matrix_mul {
-    const uint32_t* matrix_a;
-    const uint32_t* matrix_b;
-    uint32_t* result;
-    uint32_t tid;
-};
-
-
-static void* mul_worker(void* arg) {
-        
-        struct matrix_mul *mul_data = (struct matrix_mul*) arg;
-         const int width = g_width;
-        const int threads = g_nthreads;
-        const int row_count = (mul_data->tid * width) / threads;
-        const int row = ((mul_data->tid + 1) * width) / threads;
-       
-        
-        for(int y = row_count; y < row; ++y) {        
-          for(int k = 0; k < width; ++k) {
-            for(int x = 0; x < width; ++x) {
-                mul_data->result[CELL(x, y)]  += mul_data->matrix_a[CELL(k, y)] * mul_data->matrix_b[CELL(x, k)];
-            }
-          }
-        }
+    add_traffic(2 * g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), 2 * (uint64_t) g_elements * g_width);
+}
 
-        return NULL;
 
-}
 uint32_t* matrix_mul(const uint32_t* matrix_a, const uint32_t* matrix_b) {
     
-    uint32_t* result = new_matrix();
-    const int threads = g_nthreads;
-    
-    pthread_t thread_id[threads];
-
-    struct matrix_mul *m_add = malloc(sizeof(struct matrix_mul) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return result;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_mul) {
-            .result = result,
-            .matrix_a = matrix_a,
-            .matrix_b = matrix_b,
-            .tid = i,
-        };
-    }
-
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, mul_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return result;
-        }
-    }
+    uint32_t* result = alloc_matrix();
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return result;
-        }
-    }
-
-    free(m_add);
-    
+    strassen(g_width, matrix_a, matrix_b, result, g_strassen);
+    add_product();
 
     return result;
 }
 
 /**
  * Returns new matrix, powering the matrix to the exponent
+ *
+ * Uses square-and-multiply, so only O(log exponent) products are needed.
+ * The result, the running square and one scratch buffer rotate roles
+ * after each product, so no memory is allocated inside the loop.
  */
+uint32_t* matrix_pow(const uint32_t* matrix, uint32_t exponent) {
 
-pthread_mutex_t mutex;
-pthread_mutex_t mutexTwo;
-
-struct pow_struct {
-    const uint32_t* matrix;
-    uint32_t* result;
-    int exponent;
-    int threads;
-
-};
-
-void* pow_worker(void* arg) {
-        
-    struct pow_struct * mul_data = (struct pow_struct*) arg;
-    const int elements = g_elements;
-    int threads = mul_data->threads;
-    int multiplyCount;
-    int start = 1;
-    uint32_t* newResult;
-
-    if(threads == 1) {
-        multiplyCount = mul_data->exponent;
-    }
-    else {
-       multiplyCount =  ((mul_data->exponent) / (threads)) ;
-    }
-    for(int i = start; i <  multiplyCount; ++i) {
-        
-        if(i == start) {
-            pthread_mutex_lock(&mutex);
-            mul_data->result = matrix_mul(mul_data->matrix, mul_data->matrix);
-            pthread_mutex_unlock(&mutex);
+    if (exponent == 0) {
+        return identity_matrix();
+    }
+
+    uint32_t* result = alloc_matrix();
+    uint32_t* square = alloc_matrix();
+    uint32_t* scratch = alloc_matrix();
+    uint32_t* swap;
+
+    const uint32_t* base = matrix;
+    bool have_result = false;
+
+    while (true) {
+        if (exponent & 1) {
+            if (!have_result) {
+                struct matrix_clone m_add = {
+                    .toClone = base,
+                    .result = result
+                };
+                pool_steal(clone_worker, &m_add, g_elements, MATRIX_GRAIN);
+                add_traffic(g_elements * sizeof(uint32_t), g_elements * sizeof(uint32_t), 0);
+                have_result = true;
+            } else {
+                strassen(g_width, result, base, scratch, g_strassen);
+                add_product();
+                swap = result;
+                result = scratch;
+                scratch = swap;
+            }
         }
-        else {
-            pthread_mutex_lock(&mutexTwo);
-            newResult = matrix_mul(mul_data->result, mul_data->matrix);
-            memmove(mul_data->result, newResult,  sizeof(uint32_t) * elements);
-            free(newResult);
-            pthread_mutex_unlock(&mutexTwo);
+
+        exponent >>= 1;
+        if (exponent == 0) {
+            break;
         }
 
+        uint32_t* next = base == square ? scratch : square;
+        strassen(g_width, base, base, next, g_strassen);
+        add_product();
+        if (next == scratch) {
+            scratch = square;
+            square = next;
+        }
+        base = square;
     }
 
-    return NULL;
+    release_matrix(square);
+    release_matrix(scratch);
 
-}
+    return result;
 
+    /*
+        to do
 
-uint32_t* matrix_pow(const uint32_t* matrix, uint32_t exponent) {
-
-    uint32_t* result;
-    const int noElements = g_elements;
-    switch(exponent) {
-        case 0: {
-            result = identity_matrix();
-            return result;
-        }
-        case 1: {
-            result = new_matrix();
-            memmove(result, matrix, sizeof(uint32_t) * noElements); 
-            return result;
-        }
-    }
-    
-    int threads = g_nthreads;
-    if(threads > (exponent >> 1)) {
-        threads = exponent >> 1;
-    }
-
-    result = new_matrix();
-
-    pthread_t thread_id[threads];
-
-
-    struct pow_struct *m_add = malloc(sizeof(struct pow_struct) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return result;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct pow_struct) {
-            .result = result,
-            .matrix = matrix,
-            .exponent = exponent,
-            .threads = threads
-        };
-    }
-
-
-    for(size_t i = 0; i < threads; ++i) {
-        if(pthread_create(thread_id + i, NULL, pow_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return result;
-        }
-    }
-
-    for(size_t i = 0; i < threads; ++i) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return result;
-        }
-
-
-    }
-
-    memmove(result, m_add[0].result, sizeof(uint32_t) * noElements);
-
-    for(int i = 0; i < threads; i++) {
-        free(m_add[i].result);
-    }
-
-    free(m_add);
-
-    if(threads == 1) {
-        return result; 
-    }
-
-    
-   return matrix_pow(result, threads);
-
-  /*  for(int i = 0; i < threads - 1; ++i) {
-        if(i == 0)
-            result = matrix_mul(m_add[i].result, m_add[i + 1].result);
-        else {
-            memmove(result, matrix_mul(result, m_add[i + 1].result), sizeof(uint32_t) * noElements);
-        }
-
-    }   */
-
- 
-/*
-  for(int i = 1; i < exponent; i++) {
-       if(i == 1) {
-        result = matrix_mul(matrix, matrix);
-       }
-       else {
-        memmove(newResult, result, sizeof(uint32_t) * noElements);
-        free(result);
-        result  = matrix_mul(newResult, matrix);
-       }
-  }*/
-    /*
-        to do
-
-        1 2        1 0
-        3 4 ^ 0 => 0 1
+        1 2        1 0
+        3 4 ^ 0 => 0 1
 
         1 2        1 2
         3 4 ^ 1 => 3 4
@@ -792,98 +804,39 @@ uint32_t* matrix_pow(const uint32_t* matrix, uint32_t exponent) {
         1 2        199 290
         3 4 ^ 4 => 435 634
     */
-   
 }
 
 ////////////////////////////////
 ///       COMPUTATIONS       ///
 ////////////////////////////////
 
+static void count_combine(void* result, const void* partial) {
+
+    *(uint32_t*) result += *(const uint32_t*) partial;
+}
+
 /**
  * Returns the sum of all elements
  */
 
-/*
-
-static void* sum_worker(void * arg) {
-    
-    
-    struct matrix_add *matrix = (struct matrix_add *) arg;
-    const int elements = g_elements;
-    const int threads = g_nthreads;
-    const size_t start = matrix->tid * elements / threads;
-    const size_t end = matrix->tid == threads - 1 ? elements : (matrix->tid + 1) * elements / threads;
-
-    for(size_t i = start; i < end; i++) {
-      matrix->scalar += matrix->matrix[i];
-    }
-
-    return NULL;
+static void sum_worker(void* arg, ssize_t start, ssize_t end, void* partial) {
 
+    struct matrix_trace *matrix = (struct matrix_trace *) arg;
 
+    *(uint32_t*) partial += simd_sum(matrix->matrix + start, end - start);
 }
 
-*/
 uint32_t get_sum(const uint32_t* matrix) {
-  // const int threads = g_nthreads;
- //  pthread_t thread_id[threads];
-    uint32_t sum = 0;
-   const int width = g_width;
 
-   switch(width) {
-        case 1: {
-            return matrix[0];
-        }
+    struct matrix_trace m_add = {
+        .matrix = matrix
+    };
 
-        case 2: {
-            return matrix[0] + matrix[1] + matrix[2] + matrix[3];
-        }
-
-   };
-    
-   /* struct matrix_trace *m_add = malloc(sizeof(struct matrix_trace) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return 0;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_trace) {
-            .matrix = matrix,
-            .tid = i,
-            .scalar = 0
-        };
-    }
-
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, sum_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return 0;
-        }
-    }
-
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return 0;
-        }
-    }
-
-    for(size_t i = 0; i < threads; i++) {
-        sum += m_add[i].scalar;
-    }
-
-    free(m_add); 
+    uint32_t sum = 0;
+    pool_reduce(sum_worker, count_combine, &m_add, g_elements, &sum, sizeof(sum));
+    add_traffic(g_elements * sizeof(uint32_t), 0, g_elements);
 
     return sum;
-*/
-    for(int i = 0; i < width / 2; i++) {
-        for(int j = 0; j < width; j++) {
-            sum += matrix[CELL(j, i)] + matrix[CELL(width - j - 1, width - i - 1)];
-        }
-    }
-
-    return sum;    
- }
 
     /*
         to do
@@ -894,174 +847,71 @@ uint32_t get_sum(const uint32_t* matrix) {
         1 1
         1 1 => 4
     */
+}
 
 /**
  * Returns the trace of the matrix
  */
-/*
-void* trace_worker(void* arg) {
 
-    struct matrix_trace *matrix = (struct matrix_trace *) arg;
-    
-    const size_t start = (matrix->tid * g_width) / g_nthreads;
-    const size_t end =  (((matrix->tid + 1) * g_width) / g_nthreads);
-   
-    for(int i = start; i < end; i++) {
-        if(end - i - 1  < i) {
-            break;
-        }
+static void trace_worker(void* arg, ssize_t start, ssize_t end, void* partial) {
 
-        if(i == (end - i - 1)) {
-            matrix->scalar  += matrix->matrix[CELL(i,i)];
-            break;
-        }
-        matrix->scalar += matrix->matrix[CELL(i,i)] + matrix->matrix[CELL(end - i - 1, end -i - 1)];
+    struct matrix_trace *matrix = (struct matrix_trace *) arg;
+    uint32_t trace = 0;
 
-        
+    for (ssize_t i = start; i < end; i++) {
+        trace += matrix->matrix[CELL(i, i)];
     }
- 
-    return NULL;
-    
 
+    *(uint32_t*) partial += trace;
 }
-*/
-uint32_t get_trace(const uint32_t* matrix) {
-
-   /* uint32_t trace = 0 ;
-
-
-    pthread_t thread_id[g_nthreads];
-    
-    struct matrix_trace *m_add = malloc(sizeof(struct matrix_trace) * g_nthreads);
-    if(!m_add) {
-        perror("malloc");
-         return 0;
-     }
-
-    for(int i = 0; i < g_nthreads; i++) {
-        m_add[i] = (struct matrix_trace) {
-            .matrix = matrix,
-            .tid = i,
-            .scalar = 0
-        };
-    }
-
-    for(size_t i = 0; i < g_nthreads; i++) {
-        if(pthread_create(thread_id + i, NULL, trace_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return 0;
-        }
-    }
 
-    for(size_t i = 0; i < g_nthreads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return 0;
-        }
-    }
-    
-    for(size_t i = 0; i < g_nthreads; i++) {
-        trace += m_add[i].scalar;
-    }
-
-    free(m_add);
-    
-    return trace;
-
-
-*/
-    int trace = 0;
-    const int width = g_width;
-
-    for(int i = 0; i < width / 2; i++) {
-        if(width - i - 1  < i) {
-            break;
-        }
+uint32_t get_trace(const uint32_t* matrix) {
 
-        if(i == (width - i - 1)) {
-            trace += matrix[CELL(i,i)];
-            break;
-        }
-        trace += matrix[CELL(i,i)] + matrix[CELL(width - i - 1, width -i - 1)];
+    struct matrix_trace m_add = {
+        .matrix = matrix
+    };
 
-        
-    }
+    uint32_t trace = 0;
+    pool_reduce(trace_worker, count_combine, &m_add, g_width, &trace, sizeof(trace));
+    add_traffic(g_width * sizeof(uint32_t), 0, g_width);
 
     return trace;
-
 }
 
 /**
  * Returns the smallest value in the matrix
  */
 
-static void* min_worker(void * arg) {
-    
+static void min_worker(void* arg, ssize_t start, ssize_t end, void* partial) {
     
-    struct matrix_add *matrix = (struct matrix_add *) arg;
-    const int elements = g_elements;
-    const int threads = g_nthreads; 
-    const size_t start = matrix->tid * elements / threads;
-    const size_t end = matrix->tid == threads - 1 ? elements : (matrix->tid + 1) * elements / threads; 
-
-     
-    uint32_t minimum = UINT32_MAX;
+    struct matrix_trace *matrix = (struct matrix_trace *) arg;
+    uint32_t minimum = *(uint32_t*) partial;
 
-    for(size_t i = start; i < end; i++) {
+    for(ssize_t i = start; i < end; i++) {
        if(matrix->matrix[i] < minimum) {
              minimum = matrix->matrix[i];
-             matrix->scalar = matrix->matrix[i];
        }
     }
 
-    return NULL;
+    *(uint32_t*) partial = minimum;
+}
 
+static void min_combine(void* result, const void* partial) {
 
+    if(*(const uint32_t*) partial < *(uint32_t*) result) {
+        *(uint32_t*) result = *(const uint32_t*) partial;
+    }
 }
 
 uint32_t get_minimum(const uint32_t* matrix) {
 
-    const int threads = g_nthreads;
-
-    pthread_t thread_id[threads];
-    
-    struct matrix_trace *m_add = malloc(sizeof(struct matrix_trace) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return 0;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_trace) {
-            .matrix = matrix,
-            .tid = i,
-            .scalar = matrix[0]
-        };
-    }
+    struct matrix_trace m_add = {
+        .matrix = matrix
+    };
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, min_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return 0;
-        }
-    }
-
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return 0;
-        }
-    }
-    
     uint32_t minimum = UINT32_MAX;
-
-
-    for(size_t i = 0; i < threads; i++) {
-        if(m_add[i].scalar < minimum) {
-            minimum = m_add[i].scalar;
-        }
-    }
-
-    free(m_add);
-    
+    pool_reduce(min_worker, min_combine, &m_add, g_elements, &minimum, sizeof(minimum));
+    add_traffic(g_elements * sizeof(uint32_t), 0, g_elements);
 
     return minimum;
     
@@ -1082,77 +932,39 @@ uint32_t get_minimum(const uint32_t* matrix) {
  */
 
 struct matrix_max {
-    uint32_t tid;
-    uint32_t scalar;
     const uint32_t* matrix;
 
 };
-static void* max_worker(void * arg) {
-    
+static void max_worker(void* arg, ssize_t start, ssize_t end, void* partial) {
     
     struct matrix_max *matrix = (struct matrix_max *) arg;
-   const int elements = g_elements;
-      const int threads = g_nthreads; 
-    const size_t start = matrix->tid * elements / threads;
-    const size_t end = matrix->tid == threads - 1 ? elements : (matrix->tid + 1) * elements / threads;
-     
-    uint32_t max = 0;
+    uint32_t max = *(uint32_t*) partial;
 
-    for(size_t i = start; i < end; i++) {
+    for(ssize_t i = start; i < end; i++) {
        if(matrix->matrix[i] > max) {
              max = matrix->matrix[i];
-             matrix->scalar = max;
        }
     }
 
-    return NULL;
+    *(uint32_t*) partial = max;
+}
 
+static void max_combine(void* result, const void* partial) {
 
+    if(*(const uint32_t*) partial > *(uint32_t*) result) {
+        *(uint32_t*) result = *(const uint32_t*) partial;
+    }
 }
 
 uint32_t get_maximum(const uint32_t* matrix) {
-    const int threads = g_nthreads;
-
-    pthread_t thread_id[threads];
-    
-    struct matrix_max *m_add = malloc(sizeof(struct matrix_max) * threads);
-    if(!m_add) {
-        perror("malloc");
-         return 0;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_max) {
-            .matrix = matrix,
-            .tid = i,
-            .scalar = matrix[0]
-        };
-    }
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, max_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return 0;
-        }
-    }
+    struct matrix_max m_add = {
+        .matrix = matrix
+    };
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return 0;
-        }
-    }
-    
     uint32_t max = 0;
-
-
-    for(size_t i = 0; i < threads; i++) {
-        if(m_add[i].scalar > max) {
-            max = m_add[i].scalar;
-        }
-    }
-
-    free(m_add);
-    
+    pool_reduce(max_worker, max_combine, &m_add, g_elements, &max, sizeof(max));
+    add_traffic(g_elements * sizeof(uint32_t), 0, g_elements);
 
     return max;
 
@@ -1175,85 +987,386 @@ uint32_t get_maximum(const uint32_t* matrix) {
 struct matrix_freq {
     
     const uint32_t* matrix;
-    uint32_t tid;
     uint32_t scalar;
-    uint32_t count;
 
 };
 
-void* frequency_worker(void* arg) {
+static void frequency_worker(void* arg, ssize_t start, ssize_t end, void* partial) {
         
     struct matrix_freq* matrix = (struct matrix_freq*) arg;
-    const int noElement = g_elements;
-    const int threads = g_nthreads; 
-    const size_t start = matrix->tid * noElement / threads;
-    const size_t end = matrix->tid == threads - 1 ? noElement : (matrix->tid + 1) * noElement / threads;
-     
-
     uint32_t count = 0;
-    for(size_t i = start; i < end; i++) {
+
+    for(ssize_t i = start; i < end; i++) {
        if(matrix->matrix[i] == matrix->scalar) {
              count++;
-             matrix->count = count;
        }
     }
 
-    return NULL;
-    
+    *(uint32_t*) partial += count;
+}
+
+uint32_t get_frequency(const uint32_t* matrix, uint32_t value) {
+
+    struct matrix_freq m_add = {
+        .matrix = matrix,
+        .scalar = value
+    };
+
+    uint32_t count = 0;
+    pool_reduce(frequency_worker, count_combine, &m_add, g_elements, &count, sizeof(count));
+    add_traffic(g_elements * sizeof(uint32_t), 0, g_elements);
+
+    return count;
+
 
 }
 
+/**
+ * Returns the sum, trace, minimum, maximum and frequency of value in a
+ * single pass over the matrix
+ */
 
-uint32_t get_frequency(const uint32_t* matrix, uint32_t value) {
-    const int threads = g_nthreads;
+static void stats_worker(void* arg, ssize_t start, ssize_t end, void* partial) {
 
-    pthread_t thread_id[threads];
-    
-    struct matrix_freq  *m_add = malloc(sizeof(struct matrix_freq) * threads);
-    if(!m_add) {
+    struct matrix_freq* matrix = (struct matrix_freq*) arg;
+    struct matrix_stats* stats = (struct matrix_stats*) partial;
+
+    struct simd_scan scan = {
+        .sum = stats->sum,
+        .minimum = stats->minimum,
+        .maximum = stats->maximum,
+        .count = stats->frequency
+    };
+
+    simd_scan(matrix->matrix + start, end - start, matrix->scalar, &scan);
+
+    /* diagonal elements are every (width + 1)th, and already in cache */
+    const ssize_t stride = g_width + 1;
+    for (ssize_t i = (start + stride - 1) / stride * stride; i < end; i += stride) {
+        stats->trace += matrix->matrix[i];
+    }
+
+    stats->sum = scan.sum;
+    stats->minimum = scan.minimum;
+    stats->maximum = scan.maximum;
+    stats->frequency = scan.count;
+}
+
+static void stats_combine(void* result, const void* partial) {
+
+    struct matrix_stats* total = (struct matrix_stats*) result;
+    const struct matrix_stats* part = (const struct matrix_stats*) partial;
+
+    total->sum += part->sum;
+    total->trace += part->trace;
+    total->minimum = part->minimum < total->minimum ? part->minimum : total->minimum;
+    total->maximum = part->maximum > total->maximum ? part->maximum : total->maximum;
+    total->frequency += part->frequency;
+}
+
+struct matrix_stats get_stats(const uint32_t* matrix, uint32_t value) {
+
+    struct matrix_freq m_add = {
+        .matrix = matrix,
+        .scalar = value
+    };
+
+    struct matrix_stats stats = {
+        .sum = 0,
+        .trace = 0,
+        .minimum = UINT32_MAX,
+        .maximum = 0,
+        .frequency = 0
+    };
+
+    /* partials are seeded from stats, so they start at the identities */
+    pool_reduce(stats_worker, stats_combine, &m_add, g_elements, &stats, sizeof(stats));
+    add_traffic(g_elements * sizeof(uint32_t), 0, 4 * (uint64_t) g_elements);
+
+    return stats;
+}
+
+////////////////////////////////
+///      FREQUENCY INDEX     ///
+////////////////////////////////
+
+/*
+ * An index is a copy of the matrix cut into one slice per thread, each
+ * slice sorted on its own. The frequency of a value is then the sum over
+ * slices of the width of its run, found by binary search, so no merge is
+ * needed and every slice is sorted by the thread that copied it.
+ */
+
+/* least significant digit first radix sort, skipping passes over a digit all values share */
+#define INDEX_BITS 11
+#define INDEX_RADIX (1 << INDEX_BITS)
+#define INDEX_PASSES 3
+
+struct matrix_index {
+    uint32_t* values;
+    ssize_t slices;
+};
+
+struct matrix_sort {
+    const uint32_t* matrix;
+    uint32_t* scratch;
+    struct matrix_index* index;
+};
+
+static void index_worker(void* arg, ssize_t start, ssize_t end) {
+
+    struct matrix_sort* sort = (struct matrix_sort*) arg;
+    const struct matrix_index* index = sort->index;
+
+    for (ssize_t slice = start; slice < end; slice++) {
+        const ssize_t first = slice * g_elements / index->slices;
+        const ssize_t count = (slice + 1) * g_elements / index->slices - first;
+
+        /* one histogram per digit, all gathered in one read */
+        uint32_t counts[INDEX_PASSES][INDEX_RADIX] = { { 0 } };
+        for (ssize_t i = 0; i < count; i++) {
+            const uint32_t value = sort->matrix[first + i];
+            for (int pass = 0; pass < INDEX_PASSES; pass++) {
+                counts[pass][(value >> (INDEX_BITS * pass)) & (INDEX_RADIX - 1)]++;
+            }
+        }
+
+        const uint32_t* src = sort->matrix + first;
+        uint32_t* dst = index->values + first;
+
+        for (int pass = 0; pass < INDEX_PASSES; pass++) {
+            const int shift = INDEX_BITS * pass;
+            uint32_t offset = 0;
+            bool shared = false;
+
+            for (int digit = 0; digit < INDEX_RADIX; digit++) {
+                const uint32_t n = counts[pass][digit];
+                shared |= n == count;
+                counts[pass][digit] = offset;
+                offset += n;
+            }
+
+            /* random matrices only use the low 15 bits, so this skips one pass */
+            if (shared) {
+                continue;
+            }
+
+            for (ssize_t i = 0; i < count; i++) {
+                dst[counts[pass][(src[i] >> shift) & (INDEX_RADIX - 1)]++] = src[i];
+            }
+
+            src = dst;
+            dst = dst == index->values + first ? sort->scratch + first : index->values + first;
+        }
+
+        if (src != index->values + first) {
+            simd_copy(index->values + first, src, count);
+        }
+    }
+}
+
+/**
+ * Returns a new frequency index of given matrix
+ */
+struct matrix_index* index_matrix(const uint32_t* matrix) {
+
+    struct matrix_index* index = malloc(sizeof(struct matrix_index));
+    if (!index) {
         perror("malloc");
-         return 0;
-     }
-
-    for(int i = 0; i < threads; i++) {
-        m_add[i] = (struct matrix_freq) {
-            .matrix = matrix,
-            .tid = i,
-            .scalar = value,
-            .count = 0
-        };
+        exit(1);
     }
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_create(thread_id + i, NULL, frequency_worker, m_add + i) != 0) {
-            perror("Thread creation failed");
-            return 0;
+    index->values = alloc_matrix();
+    index->slices = pool_size() < g_elements ? pool_size() : g_elements;
+
+    struct matrix_sort m_add = {
+        .matrix = matrix,
+        .scratch = alloc_matrix(),
+        .index = index
+    };
+
+    pool_for(index_worker, &m_add, index->slices);
+    add_traffic(4 * g_elements * sizeof(uint32_t), 3 * g_elements * sizeof(uint32_t),
+                3 * (uint64_t) g_elements);
+
+    release_matrix(m_add.scratch);
+
+    return index;
+}
+
+/**
+ * Returns the first position in sorted values[0, count) not less than value
+ */
+static ssize_t lower_bound(const uint32_t* values, ssize_t count, uint64_t value) {
+
+    ssize_t first = 0;
+
+    while (count > 0) {
+        const ssize_t half = count / 2;
+        if (values[first + half] < value) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
         }
     }
 
-    for(size_t i = 0; i < threads; i++) {
-        if(pthread_join(thread_id[i], NULL) != 0) {
-            return 0;
+    return first;
+}
+
+/**
+ * Returns the number of elements equal to value in the indexed matrix
+ */
+uint32_t index_frequency(const struct matrix_index* index, uint32_t value) {
+
+    uint32_t frequency = 0;
+
+    for (ssize_t slice = 0; slice < index->slices; slice++) {
+        const ssize_t first = slice * g_elements / index->slices;
+        const ssize_t count = (slice + 1) * g_elements / index->slices - first;
+        const uint32_t* values = index->values + first;
+
+        frequency += lower_bound(values, count, (uint64_t) value + 1) -
+                     lower_bound(values, count, value);
+    }
+
+    return frequency;
+}
+
+/**
+ * Releases given frequency index
+ */
+void release_index(struct matrix_index* index) {
+
+    if (index == NULL) {
+        return;
+    }
+
+    release_matrix(index->values);
+    free(index);
+}
+
+////////////////////////////////
+///        PERSISTENCE       ///
+////////////////////////////////
+
+/*
+ * A saved matrix is a header padded to BUFFER_PAGE bytes followed by the
+ * raw elements in native byte order, so the data is page aligned in the
+ * file and can be mapped directly
+ */
+
+#define MATRIX_MAGIC "MATRIX32"
+#define MATRIX_ENDIAN 0x01020304
+
+struct matrix_file {
+    char magic[8];
+    uint32_t endian;
+    uint32_t element;
+    uint64_t order;
+};
+
+/**
+ * Writes all of data to fd, returning false on error
+ */
+static bool write_all(int fd, const void* data, size_t length) {
+
+    const char* p = (const char*) data;
+
+    while (length > 0) {
+        const ssize_t written = write(fd, p, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
         }
+        p += written;
+        length -= written;
     }
-    
-    uint32_t count = 0;
 
+    return true;
+}
 
-    for(size_t i = 0; i < threads; i++) {
-            count += m_add[i].count;
+/**
+ * Saves given matrix to path, returning false on error. The matrix is
+ * written to a temporary file beside path and renamed over it, so a
+ * matrix loaded from path keeps its own copy of the old file, even when
+ * it is the matrix being saved.
+ */
+bool save_matrix(const uint32_t* matrix, const char* path) {
+
+    const size_t length = strlen(path);
+    char* temporary = malloc(length + sizeof(".XXXXXX"));
+    if (!temporary) {
+        perror("malloc");
+        exit(1);
     }
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".XXXXXX", sizeof(".XXXXXX"));
 
-    free(m_add);
-    
+    const int fd = mkstemp(temporary);
+    if (fd < 0) {
+        free(temporary);
+        return false;
+    }
 
-    return count;
+    /* mkstemp creates the file 0600, give it the mode open would have */
+    const mode_t mask = umask(0);
+    umask(mask);
 
+    char header[BUFFER_PAGE] = { 0 };
+    const struct matrix_file file = {
+        .magic = MATRIX_MAGIC,
+        .endian = MATRIX_ENDIAN,
+        .element = sizeof(uint32_t),
+        .order = g_width
+    };
+    memcpy(header, &file, sizeof(file));
 
+    bool saved = fchmod(fd, 0644 & ~mask) == 0 &&
+                 write_all(fd, header, sizeof(header)) &&
+                 write_all(fd, matrix, g_elements * sizeof(uint32_t)) &&
+                 fsync(fd) == 0;
+    add_traffic(g_elements * sizeof(uint32_t), sizeof(header) + g_elements * sizeof(uint32_t), 0);
+
+    saved = close(fd) == 0 && saved && rename(temporary, path) == 0;
+    if (!saved) {
+        unlink(temporary);
+    }
+
+    free(temporary);
+    return saved;
 }
 
+/**
+ * Returns the matrix saved at path, mapped copy-on-write so pages are
+ * only read when touched and writes never reach the file. Returns NULL if
+ * the file is not a saved matrix of the current order.
+ */
+uint32_t* load_matrix(const char* path) {
 
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
 
+    const size_t bytes = g_elements * sizeof(uint32_t);
+    struct matrix_file file;
+    struct stat status;
+    uint32_t* result = NULL;
 
+    if (fstat(fd, &status) == 0 && (size_t) status.st_size >= BUFFER_PAGE + bytes &&
+        pread(fd, &file, sizeof(file), 0) == sizeof(file) &&
+        memcmp(file.magic, MATRIX_MAGIC, sizeof(file.magic)) == 0 &&
+        file.endian == MATRIX_ENDIAN && file.element == sizeof(uint32_t) &&
+        file.order == (uint64_t) g_width) {
+        result = buffer_map_file(fd, bytes);
+        add_traffic(sizeof(file), 0, 0);
+    }
 
+    /* the mapping stays valid once the descriptor is closed */
+    close(fd);
 
+    return result;
+}
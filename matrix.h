@@ -2,6 +2,32 @@
 #define MATRIX_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+enum page_policy {
+    PAGES_DEFAULT,
+    PAGES_THP,
+    PAGES_HUGETLB
+};
+
+struct matrix_stats {
+    uint32_t sum;
+    uint32_t trace;
+    uint32_t minimum;
+    uint32_t maximum;
+    uint32_t frequency;
+};
+
+/* sorted copy of a matrix answering frequency queries */
+struct matrix_index;
+
+/* bytes moved and operations performed by matrix operations */
+struct matrix_traffic {
+    uint64_t read;
+    uint64_t written;
+    uint64_t ops;
+};
 
 /* utility functions */
 
@@ -9,7 +35,14 @@ uint32_t fast_rand(void);
 
 void set_seed(uint32_t value);
 void set_nthreads(ssize_t count);
+void set_pinning(bool pin);
 void set_dimensions(ssize_t width);
+void set_strassen_threshold(ssize_t order);
+void set_retained_limit(size_t bytes);
+void set_page_policy(enum page_policy policy);
+
+void add_traffic(uint64_t read, uint64_t written, uint64_t ops);
+struct matrix_traffic get_traffic(void);
 
 void display(const uint32_t* matrix);
 void display_row(const uint32_t* matrix, ssize_t row);
@@ -19,6 +52,10 @@ void display_element(const uint32_t* matrix, ssize_t row, ssize_t column);
 /* matrix operations */
 
 uint32_t* new_matrix(void);
+uint32_t* alloc_matrix(void);
+void release_matrix(uint32_t* matrix);
+size_t huge_pages(const uint32_t* matrix);
+
 uint32_t* identity_matrix(void);
 uint32_t* random_matrix(uint32_t seed);
 uint32_t* uniform_matrix(uint32_t value);
@@ -34,6 +71,11 @@ uint32_t* matrix_pow(const uint32_t* matrix, uint32_t exponent);
 uint32_t* matrix_add(const uint32_t* matrix_a, const uint32_t* matrix_b);
 uint32_t* matrix_mul(const uint32_t* matrix_a, const uint32_t* matrix_b);
 
+/* persistence */
+
+bool save_matrix(const uint32_t* matrix, const char* path);
+uint32_t* load_matrix(const char* path);
+
 /* compute operations */
 
 uint32_t get_sum(const uint32_t* matrix);
@@ -41,5 +83,10 @@ uint32_t get_trace(const uint32_t* matrix);
 uint32_t get_minimum(const uint32_t* matrix);
 uint32_t get_maximum(const uint32_t* matrix);
 uint32_t get_frequency(const uint32_t* matrix, uint32_t value);
+struct matrix_stats get_stats(const uint32_t* matrix, uint32_t value);
+
+struct matrix_index* index_matrix(const uint32_t* matrix);
+uint32_t index_frequency(const struct matrix_index* index, uint32_t value);
+void release_index(struct matrix_index* index);
 
 #endif
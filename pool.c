@@ -0,0 +1,480 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "pool.h"
+
+/*
+ * Long-lived worker pool. The calling thread acts as tid 0 and the pool
+ * owns the remaining (size - 1) threads, which sleep on a barrier between
+ * dispatches instead of being created and joined for every operation.
+ */
+
+static ssize_t g_size = 1;
+static pthread_t* g_threads = NULL;
+
+static pthread_barrier_t g_start;
+static pthread_barrier_t g_finish;
+static pthread_mutex_t g_dispatch = PTHREAD_MUTEX_INITIALIZER;
+
+static pool_task_fn g_task = NULL;
+static void* g_arg = NULL;
+
+static unsigned char* g_partials = NULL;
+
+/*
+ * One deque of chunk indices per tid for pool_steal, held as the range
+ * [next, end) packed into one word so that taking from the front and
+ * stealing from the back are each a single compare-and-swap
+ */
+struct pool_deque {
+    _Atomic uint64_t range;
+} __attribute__((aligned(64)));
+
+#define RANGE(next, end)  (((uint64_t) (end) << 32) | (uint32_t) (next))
+#define RANGE_NEXT(range) ((ssize_t) (uint32_t) (range))
+#define RANGE_END(range)  ((ssize_t) ((range) >> 32))
+
+static struct pool_deque* g_deques = NULL;
+
+/* with pinning, tid i runs on g_cpus[i % g_ncpus], ordered by package */
+static bool g_pin = false;
+static int* g_cpus = NULL;
+static ssize_t g_ncpus = 0;
+static cpu_set_t g_affinity;
+
+static __thread ssize_t t_tid = 0;
+static __thread bool t_busy = false;
+
+/**
+ * Returns the physical package of cpu, or 0 if the topology is unknown
+ */
+static int cpu_package(int cpu) {
+
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+
+    FILE* file = fopen(path, "r");
+    int package = 0;
+
+    if (file != NULL) {
+        if (fscanf(file, "%d", &package) != 1) {
+            package = 0;
+        }
+        fclose(file);
+    }
+
+    return package;
+}
+
+/**
+ * Lists the CPUs the calling thread may run on, grouped by package so
+ * that neighbouring tids, which own neighbouring slices, share a socket
+ */
+static void list_cpus(void) {
+
+    g_ncpus = 0;
+    g_cpus = malloc(CPU_SETSIZE * sizeof(int));
+    int* packages = malloc(CPU_SETSIZE * sizeof(int));
+    if (!g_cpus || !packages) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &g_affinity)) {
+            continue;
+        }
+
+        /* insertion sort by package, keeping CPU order within one */
+        const int package = cpu_package(cpu);
+        ssize_t i = g_ncpus++;
+        for (; i > 0 && packages[i - 1] > package; i--) {
+            g_cpus[i] = g_cpus[i - 1];
+            packages[i] = packages[i - 1];
+        }
+        g_cpus[i] = cpu;
+        packages[i] = package;
+    }
+
+    free(packages);
+}
+
+/**
+ * Pins the calling thread to the CPU of given tid
+ */
+static void pin_thread(ssize_t tid) {
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(g_cpus[tid % g_ncpus], &set);
+
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * Waits for dispatches and runs the published task until shut down
+ */
+static void* pool_worker(void* arg) {
+
+    t_tid = (ssize_t) (intptr_t) arg;
+    if (g_cpus != NULL) {
+        pin_thread(t_tid);
+    }
+
+    while (true) {
+        pthread_barrier_wait(&g_start);
+        if (g_task == NULL) {
+            break;
+        }
+
+        t_busy = true;
+        g_task(g_arg, t_tid);
+        t_busy = false;
+
+        pthread_barrier_wait(&g_finish);
+    }
+
+    return NULL;
+}
+
+/**
+ * Sets whether the next pool_init pins each tid to its own CPU
+ */
+void pool_set_pinning(bool pin) {
+
+    g_pin = pin;
+}
+
+/**
+ * Starts the worker threads, replacing any existing pool
+ */
+void pool_init(ssize_t nthreads) {
+
+    pool_destroy();
+
+    g_size = nthreads < 1 ? 1 : nthreads;
+    g_partials = aligned_alloc(64, g_size * POOL_PARTIAL_MAX);
+    g_deques = aligned_alloc(64, g_size * sizeof(struct pool_deque));
+    if (!g_partials || !g_deques) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+
+    for (ssize_t i = 0; i < g_size; i++) {
+        atomic_init(&g_deques[i].range, 0);
+    }
+
+    /* the calling thread is tid 0 and gets its own affinity back on destroy */
+    if (g_pin && pthread_getaffinity_np(pthread_self(), sizeof(g_affinity), &g_affinity) == 0) {
+        list_cpus();
+        pin_thread(0);
+    }
+
+    if (g_size == 1) {
+        return;
+    }
+
+    pthread_barrier_init(&g_start, NULL, g_size);
+    pthread_barrier_init(&g_finish, NULL, g_size);
+
+    g_threads = malloc(sizeof(pthread_t) * g_size);
+    if (!g_threads) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (ssize_t i = 1; i < g_size; i++) {
+        if (pthread_create(g_threads + i, NULL, pool_worker, (void*) (intptr_t) i) != 0) {
+            perror("Thread creation failed");
+            exit(1);
+        }
+    }
+}
+
+/**
+ * Stops and joins the worker threads
+ */
+void pool_destroy(void) {
+
+    if (g_threads != NULL) {
+        g_task = NULL;
+        pthread_barrier_wait(&g_start);
+
+        for (ssize_t i = 1; i < g_size; i++) {
+            pthread_join(g_threads[i], NULL);
+        }
+
+        pthread_barrier_destroy(&g_start);
+        pthread_barrier_destroy(&g_finish);
+
+        free(g_threads);
+        g_threads = NULL;
+    }
+
+    if (g_cpus != NULL) {
+        pthread_setaffinity_np(pthread_self(), sizeof(g_affinity), &g_affinity);
+        free(g_cpus);
+        g_cpus = NULL;
+    }
+
+    free(g_partials);
+    free(g_deques);
+    g_partials = NULL;
+    g_deques = NULL;
+    g_size = 1;
+}
+
+/**
+ * Returns the number of threads taking part in each dispatch
+ */
+ssize_t pool_size(void) {
+
+    return g_size;
+}
+
+/**
+ * Returns how many threads a dispatch from the calling thread runs on
+ * at once, which is one for dispatches nested inside a task
+ */
+ssize_t pool_concurrency(void) {
+
+    return g_threads == NULL || t_busy ? 1 : g_size;
+}
+
+/**
+ * Returns the pool index of the calling thread
+ */
+ssize_t pool_tid(void) {
+
+    return t_tid;
+}
+
+/**
+ * Runs fn once for every tid in the pool and waits for all of them.
+ * Dispatches issued from inside a task run inline on the calling thread.
+ */
+void pool_run(pool_task_fn fn, void* arg) {
+
+    if (g_threads == NULL || t_busy) {
+        for (ssize_t tid = 0; tid < g_size; tid++) {
+            fn(arg, tid);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&g_dispatch);
+
+    g_task = fn;
+    g_arg = arg;
+    pthread_barrier_wait(&g_start);
+
+    t_busy = true;
+    fn(arg, 0);
+    t_busy = false;
+
+    pthread_barrier_wait(&g_finish);
+
+    pthread_mutex_unlock(&g_dispatch);
+}
+
+struct pool_for_job {
+    pool_for_fn fn;
+    void* arg;
+    ssize_t count;
+};
+
+static void pool_for_task(void* arg, ssize_t tid) {
+
+    struct pool_for_job* job = (struct pool_for_job*) arg;
+    const ssize_t start = tid * job->count / g_size;
+    const ssize_t end = (tid + 1) * job->count / g_size;
+
+    if (start < end) {
+        job->fn(job->arg, start, end);
+    }
+}
+
+/**
+ * Splits [0, count) into one contiguous range per thread and runs fn on each
+ */
+void pool_for(pool_for_fn fn, void* arg, ssize_t count) {
+
+    if (t_busy) {
+        fn(arg, 0, count);
+        return;
+    }
+
+    struct pool_for_job job = {
+        .fn = fn,
+        .arg = arg,
+        .count = count
+    };
+
+    pool_run(pool_for_task, &job);
+}
+
+struct pool_steal_job {
+    pool_for_fn fn;
+    void* arg;
+    ssize_t count;
+    ssize_t grain;
+    ssize_t chunks;
+};
+
+/**
+ * Takes the chunk at the front of deque, returning false if it is empty
+ */
+static bool take_chunk(struct pool_deque* deque, ssize_t* chunk) {
+
+    uint64_t range = atomic_load(&deque->range);
+
+    while (RANGE_NEXT(range) < RANGE_END(range)) {
+        const uint64_t rest = RANGE(RANGE_NEXT(range) + 1, RANGE_END(range));
+        if (atomic_compare_exchange_weak(&deque->range, &range, rest)) {
+            *chunk = RANGE_NEXT(range);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Moves the back half of victim's chunks, or its last chunk, into the
+ * empty deque own. Returns false if victim has nothing left.
+ */
+static bool steal_chunks(struct pool_deque* victim, struct pool_deque* own) {
+
+    uint64_t range = atomic_load(&victim->range);
+
+    while (RANGE_NEXT(range) < RANGE_END(range)) {
+        const ssize_t next = RANGE_NEXT(range);
+        const ssize_t end = RANGE_END(range);
+        const ssize_t middle = next + (end - next) / 2;
+
+        if (atomic_compare_exchange_weak(&victim->range, &range, RANGE(next, middle))) {
+            atomic_store(&own->range, RANGE(middle, end));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void pool_steal_task(void* arg, ssize_t tid) {
+
+    struct pool_steal_job* job = (struct pool_steal_job*) arg;
+    struct pool_deque* own = g_deques + tid;
+
+    /* each thread starts on the range pool_for would have given it */
+    atomic_store(&own->range, RANGE(tid * job->chunks / g_size, (tid + 1) * job->chunks / g_size));
+
+    while (true) {
+        ssize_t chunk;
+        while (take_chunk(own, &chunk)) {
+            const ssize_t start = chunk * job->grain;
+            const ssize_t end = start + job->grain < job->count ? start + job->grain : job->count;
+            job->fn(job->arg, start, end);
+        }
+
+        /* chunks in flight between two deques are run by their thief */
+        bool stolen = false;
+        for (ssize_t i = 1; i < g_size && !stolen; i++) {
+            stolen = steal_chunks(g_deques + (tid + i) % g_size, own);
+        }
+
+        if (!stolen) {
+            break;
+        }
+    }
+}
+
+/**
+ * Like pool_for, but [0, count) is cut into chunks of grain items and a
+ * thread that finishes its own chunks steals from the others, so one
+ * slow thread does not hold up the rest. fn must accept any range.
+ * Pinned threads do not steal, so each still first touches exactly its
+ * pool_for range and finds it on its own node.
+ */
+void pool_steal(pool_for_fn fn, void* arg, ssize_t count, ssize_t grain) {
+
+    if (t_busy || g_threads == NULL) {
+        fn(arg, 0, count);
+        return;
+    }
+
+    if (g_cpus != NULL) {
+        pool_for(fn, arg, count);
+        return;
+    }
+
+    /* chunk indices must fit in half of a deque word */
+    if (grain < 1 || (count + grain - 1) / grain > UINT32_MAX) {
+        grain = count / UINT32_MAX + 1;
+    }
+
+    struct pool_steal_job job = {
+        .fn = fn,
+        .arg = arg,
+        .count = count,
+        .grain = grain,
+        .chunks = (count + grain - 1) / grain
+    };
+
+    pool_run(pool_steal_task, &job);
+}
+
+struct pool_reduce_job {
+    pool_reduce_fn fn;
+    void* arg;
+    ssize_t count;
+};
+
+static void pool_reduce_task(void* arg, ssize_t tid) {
+
+    struct pool_reduce_job* job = (struct pool_reduce_job*) arg;
+    const ssize_t start = tid * job->count / g_size;
+    const ssize_t end = (tid + 1) * job->count / g_size;
+
+    if (start < end) {
+        job->fn(job->arg, start, end, g_partials + tid * POOL_PARTIAL_MAX);
+    }
+}
+
+/**
+ * Like pool_for, but each thread folds its range into a private partial
+ * seeded from *result, and the partials are combined into *result after
+ */
+void pool_reduce(pool_reduce_fn fn, pool_combine_fn combine, void* arg,
+                 ssize_t count, void* result, size_t size) {
+
+    if (t_busy) {
+        unsigned char partial[POOL_PARTIAL_MAX];
+        memcpy(partial, result, size);
+        fn(arg, 0, count, partial);
+        combine(result, partial);
+        return;
+    }
+
+    for (ssize_t tid = 0; tid < g_size; tid++) {
+        memcpy(g_partials + tid * POOL_PARTIAL_MAX, result, size);
+    }
+
+    struct pool_reduce_job job = {
+        .fn = fn,
+        .arg = arg,
+        .count = count
+    };
+
+    pool_run(pool_reduce_task, &job);
+
+    for (ssize_t tid = 0; tid < g_size; tid++) {
+        combine(result, g_partials + tid * POOL_PARTIAL_MAX);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* largest per-thread partial result accepted by pool_reduce */
+#define POOL_PARTIAL_MAX 64
+
+typedef void (*pool_task_fn)(void* arg, ssize_t tid);
+typedef void (*pool_for_fn)(void* arg, ssize_t start, ssize_t end);
+typedef void (*pool_reduce_fn)(void* arg, ssize_t start, ssize_t end, void* partial);
+typedef void (*pool_combine_fn)(void* result, const void* partial);
+
+/* lifetime */
+
+void pool_set_pinning(bool pin);
+void pool_init(ssize_t nthreads);
+void pool_destroy(void);
+
+ssize_t pool_size(void);
+ssize_t pool_concurrency(void);
+ssize_t pool_tid(void);
+
+/* dispatch */
+
+void pool_run(pool_task_fn fn, void* arg);
+void pool_for(pool_for_fn fn, void* arg, ssize_t count);
+void pool_steal(pool_for_fn fn, void* arg, ssize_t count, ssize_t grain);
+void pool_reduce(pool_reduce_fn fn, pool_combine_fn combine, void* arg,
+                 ssize_t count, void* result, size_t size);
+
+#endif
@@ -0,0 +1,700 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <immintrin.h>
+#include "simd.h"
+
+/*
+ * Elementwise uint32 kernels, built once per instruction set and selected
+ * at startup by simd_init(). Every kernel peels scalar elements until the
+ * destination is vector aligned, then streams four vectors per iteration
+ * with aligned stores (and aligned loads when the sources share the
+ * destination's alignment, which is always the case for whole matrices).
+ */
+
+struct simd_ops {
+    const char* name;
+    void (*fill)(uint32_t* dst, uint32_t value, ssize_t count);
+    void (*copy)(uint32_t* dst, const uint32_t* src, ssize_t count);
+    void (*add)(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count);
+    void (*sub)(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count);
+    void (*add_scalar)(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count);
+    void (*mul_scalar)(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count);
+    void (*transpose)(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                      ssize_t rows, ssize_t cols);
+    uint32_t (*sum)(const uint32_t* src, ssize_t count);
+    void (*scan)(const uint32_t* src, ssize_t count, uint32_t value, struct simd_scan* scan);
+    void (*sequence)(uint32_t* dst, uint32_t start, uint32_t step, ssize_t count);
+    uint32_t (*random)(uint32_t* dst, uint32_t state, ssize_t count);
+};
+
+static const uint32_t LANE_INDEX[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+static enum simd_level g_level = SIMD_GENERIC;
+static const struct simd_ops* g_ops = NULL;
+
+#define SAME_ALIGNMENT(p, q, bytes) ((((uintptr_t) (p) ^ (uintptr_t) (q)) & ((bytes) - 1)) == 0)
+
+/* runs SCALAR(i) over the unaligned head and tail and VECTOR(i, load) over the body */
+#define SIMD_LOOP(bytes, dst, count, aligned, SCALAR, VECTOR) do { \
+        const ssize_t lanes = (bytes) / (ssize_t) sizeof(uint32_t); \
+        ssize_t i = 0; \
+        for (; i < (count) && ((uintptr_t) ((dst) + i) & ((bytes) - 1)); i++) { \
+            SCALAR(i); \
+        } \
+        if (aligned) { \
+            for (; i + 4 * lanes <= (count); i += 4 * lanes) { \
+                VECTOR(i, LOAD); \
+                VECTOR(i + lanes, LOAD); \
+                VECTOR(i + 2 * lanes, LOAD); \
+                VECTOR(i + 3 * lanes, LOAD); \
+            } \
+        } else { \
+            for (; i + 4 * lanes <= (count); i += 4 * lanes) { \
+                VECTOR(i, LOADU); \
+                VECTOR(i + lanes, LOADU); \
+                VECTOR(i + 2 * lanes, LOADU); \
+                VECTOR(i + 3 * lanes, LOADU); \
+            } \
+        } \
+        for (; i + lanes <= (count); i += lanes) { \
+            VECTOR(i, LOADU); \
+        } \
+        for (; i < (count); i++) { \
+            SCALAR(i); \
+        } \
+    } while (0)
+
+#define FILL_SCALAR(i)          dst[i] = value
+#define FILL_VECTOR(i, L)       STORE(dst + (i), v)
+#define COPY_SCALAR(i)          dst[i] = src[i]
+#define COPY_VECTOR(i, L)       STORE(dst + (i), L(src + (i)))
+#define ADD_SCALAR(i)           dst[i] = a[i] + b[i]
+#define ADD_VECTOR(i, L)        STORE(dst + (i), ADD(L(a + (i)), L(b + (i))))
+#define SUB_SCALAR(i)           dst[i] = a[i] - b[i]
+#define SUB_VECTOR(i, L)        STORE(dst + (i), SUB(L(a + (i)), L(b + (i))))
+#define ADDS_SCALAR(i)          dst[i] = src[i] + scalar
+#define ADDS_VECTOR(i, L)       STORE(dst + (i), ADD(L(src + (i)), v))
+#define MULS_SCALAR(i)          dst[i] = src[i] * scalar
+#define MULS_VECTOR(i, L)       STORE(dst + (i), MUL(L(src + (i)), v))
+#define SEQ_SCALAR(i)           dst[i] = start + (uint32_t) (i) * step
+#define SEQ_VECTOR(i, L)        STORE(dst + (i), ADD(SET1(start + (uint32_t) (i) * step), ramp))
+
+/*
+ * Transposes a rows x cols block of src into dst, TILE x TILE tiles at a
+ * time with TILE_KERNEL and the ragged right and bottom edges element-wise
+ */
+#define TRANSPOSE_BLOCK(tile, TILE_KERNEL) do { \
+        ssize_t r = 0; \
+        for (; r + (tile) <= rows; r += (tile)) { \
+            ssize_t c = 0; \
+            for (; c + (tile) <= cols; c += (tile)) { \
+                TILE_KERNEL(dst + c * ldd + r, ldd, src + r * lds + c, lds); \
+            } \
+            transpose_edge(dst, ldd, src, lds, r, r + (tile), c, cols); \
+        } \
+        transpose_edge(dst, ldd, src, lds, r, rows, 0, cols); \
+    } while (0)
+
+static void scan_generic(const uint32_t* src, ssize_t count, uint32_t value, struct simd_scan* scan) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        scan->sum += src[i];
+        scan->minimum = src[i] < scan->minimum ? src[i] : scan->minimum;
+        scan->maximum = src[i] > scan->maximum ? src[i] : scan->maximum;
+        scan->count += src[i] == value;
+    }
+}
+
+static void sequence_generic(uint32_t* dst, uint32_t start, uint32_t step, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        dst[i] = start + (uint32_t) i * step;
+    }
+}
+
+static uint32_t random_generic(uint32_t* dst, uint32_t state, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        state = SIMD_RAND_MULTIPLIER * state + SIMD_RAND_INCREMENT;
+        dst[i] = (state >> 16) & 0x7FFF;
+    }
+
+    return state;
+}
+
+static void transpose_edge(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                           ssize_t row_start, ssize_t row_end, ssize_t col_start, ssize_t col_end) {
+
+    for (ssize_t r = row_start; r < row_end; r++) {
+        for (ssize_t c = col_start; c < col_end; c++) {
+            dst[c * ldd + r] = src[r * lds + c];
+        }
+    }
+}
+
+/* instantiates the elementwise kernels for the VEC/LOAD/STORE/... macros in scope */
+#define DEFINE_KERNELS(suffix, isa, bytes) \
+    __attribute__((target(isa))) \
+    static void fill_##suffix(uint32_t* dst, uint32_t value, ssize_t count) { \
+        const VEC v = SET1(value); \
+        SIMD_LOOP(bytes, dst, count, true, FILL_SCALAR, FILL_VECTOR); \
+    } \
+    __attribute__((target(isa))) \
+    static void copy_##suffix(uint32_t* dst, const uint32_t* src, ssize_t count) { \
+        SIMD_LOOP(bytes, dst, count, SAME_ALIGNMENT(dst, src, bytes), COPY_SCALAR, COPY_VECTOR); \
+    } \
+    __attribute__((target(isa))) \
+    static void add_##suffix(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count) { \
+        const bool aligned = SAME_ALIGNMENT(dst, a, bytes) && SAME_ALIGNMENT(dst, b, bytes); \
+        SIMD_LOOP(bytes, dst, count, aligned, ADD_SCALAR, ADD_VECTOR); \
+    } \
+    __attribute__((target(isa))) \
+    static void sub_##suffix(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count) { \
+        const bool aligned = SAME_ALIGNMENT(dst, a, bytes) && SAME_ALIGNMENT(dst, b, bytes); \
+        SIMD_LOOP(bytes, dst, count, aligned, SUB_SCALAR, SUB_VECTOR); \
+    } \
+    __attribute__((target(isa))) \
+    static void add_scalar_##suffix(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count) { \
+        const VEC v = SET1(scalar); \
+        SIMD_LOOP(bytes, dst, count, SAME_ALIGNMENT(dst, src, bytes), ADDS_SCALAR, ADDS_VECTOR); \
+    } \
+    __attribute__((target(isa))) \
+    static void mul_scalar_##suffix(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count) { \
+        const VEC v = SET1(scalar); \
+        SIMD_LOOP(bytes, dst, count, SAME_ALIGNMENT(dst, src, bytes), MULS_SCALAR, MULS_VECTOR); \
+    } \
+    __attribute__((target(isa))) \
+    static uint32_t sum_##suffix(const uint32_t* src, ssize_t count) { \
+        const ssize_t lanes = (bytes) / (ssize_t) sizeof(uint32_t); \
+        VEC acc0 = SET1(0), acc1 = SET1(0), acc2 = SET1(0), acc3 = SET1(0); \
+        uint32_t total = 0; \
+        ssize_t i = 0; \
+        for (; i < count && ((uintptr_t) (src + i) & ((bytes) - 1)); i++) { \
+            total += src[i]; \
+        } \
+        for (; i + 4 * lanes <= count; i += 4 * lanes) { \
+            acc0 = ADD(acc0, LOAD(src + i)); \
+            acc1 = ADD(acc1, LOAD(src + i + lanes)); \
+            acc2 = ADD(acc2, LOAD(src + i + 2 * lanes)); \
+            acc3 = ADD(acc3, LOAD(src + i + 3 * lanes)); \
+        } \
+        for (; i + lanes <= count; i += lanes) { \
+            acc0 = ADD(acc0, LOAD(src + i)); \
+        } \
+        for (; i < count; i++) { \
+            total += src[i]; \
+        } \
+        uint32_t partial[(bytes) / sizeof(uint32_t)]; \
+        acc0 = ADD(ADD(acc0, acc1), ADD(acc2, acc3)); \
+        memcpy(partial, &acc0, sizeof(partial)); \
+        for (ssize_t lane = 0; lane < lanes; lane++) { \
+            total += partial[lane]; \
+        } \
+        return total; \
+    } \
+    __attribute__((target(isa))) \
+    static void scan_##suffix(const uint32_t* src, ssize_t count, uint32_t value, struct simd_scan* scan) { \
+        const ssize_t lanes = (bytes) / (ssize_t) sizeof(uint32_t); \
+        const VEC v = SET1(value); \
+        VEC sum = SET1(0), lo = SET1(UINT32_MAX), hi = SET1(0), hits = SET1(0); \
+        ssize_t i = 0; \
+        for (; i + lanes <= count; i += lanes) { \
+            const VEC x = LOADU(src + i); \
+            sum = ADD(sum, x); \
+            lo = MINU(lo, x); \
+            hi = MAXU(hi, x); \
+            hits = COUNTEQ(hits, x, v); \
+        } \
+        uint32_t lane_sum[(bytes) / sizeof(uint32_t)], lane_lo[(bytes) / sizeof(uint32_t)]; \
+        uint32_t lane_hi[(bytes) / sizeof(uint32_t)], lane_hits[(bytes) / sizeof(uint32_t)]; \
+        memcpy(lane_sum, &sum, sizeof(lane_sum)); \
+        memcpy(lane_lo, &lo, sizeof(lane_lo)); \
+        memcpy(lane_hi, &hi, sizeof(lane_hi)); \
+        memcpy(lane_hits, &hits, sizeof(lane_hits)); \
+        for (ssize_t lane = 0; lane < lanes; lane++) { \
+            scan->sum += lane_sum[lane]; \
+            scan->minimum = lane_lo[lane] < scan->minimum ? lane_lo[lane] : scan->minimum; \
+            scan->maximum = lane_hi[lane] > scan->maximum ? lane_hi[lane] : scan->maximum; \
+            scan->count += lane_hits[lane]; \
+        } \
+        scan_generic(src + i, count - i, value, scan); \
+    } \
+    __attribute__((target(isa))) \
+    static void sequence_##suffix(uint32_t* dst, uint32_t start, uint32_t step, ssize_t count) { \
+        const VEC ramp = MUL(LOADU(LANE_INDEX), SET1(step)); \
+        SIMD_LOOP(bytes, dst, count, true, SEQ_SCALAR, SEQ_VECTOR); \
+    } \
+    /* four vectors of lanes, each a run of consecutive states, all jumping 4 * lanes steps at once */ \
+    __attribute__((target(isa))) \
+    static uint32_t random_##suffix(uint32_t* dst, uint32_t state, ssize_t count) { \
+        const ssize_t lanes = (bytes) / (ssize_t) sizeof(uint32_t); \
+        ssize_t i = 0; \
+        for (; i < count && ((uintptr_t) (dst + i) & ((bytes) - 1)); i++) { \
+            state = SIMD_RAND_MULTIPLIER * state + SIMD_RAND_INCREMENT; \
+            dst[i] = (state >> 16) & 0x7FFF; \
+        } \
+        if (i + 4 * lanes <= count) { \
+            uint32_t seeds[4 * (bytes) / sizeof(uint32_t)]; \
+            uint32_t multiplier = 1, increment = 0; \
+            for (ssize_t lane = 0; lane < 4 * lanes; lane++) { \
+                state = SIMD_RAND_MULTIPLIER * state + SIMD_RAND_INCREMENT; \
+                seeds[lane] = state; \
+                multiplier *= SIMD_RAND_MULTIPLIER; \
+                increment = SIMD_RAND_MULTIPLIER * increment + SIMD_RAND_INCREMENT; \
+            } \
+            const VEC a = SET1(multiplier), c = SET1(increment), mask = SET1(0x7FFF); \
+            VEC s0 = LOADU(seeds), s1 = LOADU(seeds + lanes); \
+            VEC s2 = LOADU(seeds + 2 * lanes), s3 = LOADU(seeds + 3 * lanes); \
+            VEC last = s3; \
+            for (; i + 4 * lanes <= count; i += 4 * lanes) { \
+                STORE(dst + i, AND(SRLI(s0, 16), mask)); \
+                STORE(dst + i + lanes, AND(SRLI(s1, 16), mask)); \
+                STORE(dst + i + 2 * lanes, AND(SRLI(s2, 16), mask)); \
+                STORE(dst + i + 3 * lanes, AND(SRLI(s3, 16), mask)); \
+                last = s3; \
+                s0 = ADD(MUL(s0, a), c); \
+                s1 = ADD(MUL(s1, a), c); \
+                s2 = ADD(MUL(s2, a), c); \
+                s3 = ADD(MUL(s3, a), c); \
+            } \
+            memcpy(seeds, &last, (bytes)); \
+            state = seeds[lanes - 1]; \
+        } \
+        return random_generic(dst + i, state, count - i); \
+    } \
+    static const struct simd_ops ops_##suffix = { \
+        .name = isa, \
+        .fill = fill_##suffix, \
+        .copy = copy_##suffix, \
+        .add = add_##suffix, \
+        .sub = sub_##suffix, \
+        .add_scalar = add_scalar_##suffix, \
+        .mul_scalar = mul_scalar_##suffix, \
+        .transpose = transpose_##suffix, \
+        .sum = sum_##suffix, \
+        .scan = scan_##suffix, \
+        .sequence = sequence_##suffix, \
+        .random = random_##suffix \
+    };
+
+////////////////////////////////
+///          AVX-512         ///
+////////////////////////////////
+
+#define VEC         __m512i
+#define LOAD(p)     _mm512_load_si512((const void*) (p))
+#define LOADU(p)    _mm512_loadu_si512((const void*) (p))
+#define STORE(p, v) _mm512_store_si512((void*) (p), (v))
+#define SET1(x)     _mm512_set1_epi32((int) (x))
+#define ADD(x, y)   _mm512_add_epi32((x), (y))
+#define SUB(x, y)   _mm512_sub_epi32((x), (y))
+#define MINU(x, y)  _mm512_min_epu32((x), (y))
+#define MAXU(x, y)  _mm512_max_epu32((x), (y))
+#define COUNTEQ(c, x, y) _mm512_mask_sub_epi32((c), _mm512_cmpeq_epi32_mask((x), (y)), (c), _mm512_set1_epi32(-1))
+#define MUL(x, y)   _mm512_mullo_epi32((x), (y))
+#define SRLI(x, n)  _mm512_srli_epi32((x), (n))
+#define AND(x, y)   _mm512_and_si512((x), (y))
+
+/**
+ * Transposes one 16 x 16 tile in registers: 32-bit and 64-bit unpacks
+ * transpose each 4 x 4 sub-block, two 128-bit lane shuffles move them
+ */
+__attribute__((target("avx512f")))
+static void transpose_tile_avx512(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds) {
+
+    __m512i r[16], t[16];
+
+    for (int i = 0; i < 16; i++) {
+        r[i] = _mm512_loadu_si512((const void*) (src + i * lds));
+    }
+    for (int i = 0; i < 16; i += 2) {
+        t[i] = _mm512_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 16; i += 4) {
+        r[i] = _mm512_unpacklo_epi64(t[i], t[i + 2]);
+        r[i + 1] = _mm512_unpackhi_epi64(t[i], t[i + 2]);
+        r[i + 2] = _mm512_unpacklo_epi64(t[i + 1], t[i + 3]);
+        r[i + 3] = _mm512_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int m = 0; m < 4; m++) {
+        t[m] = _mm512_shuffle_i32x4(r[m], r[4 + m], 0x88);
+        t[4 + m] = _mm512_shuffle_i32x4(r[m], r[4 + m], 0xDD);
+        t[8 + m] = _mm512_shuffle_i32x4(r[8 + m], r[12 + m], 0x88);
+        t[12 + m] = _mm512_shuffle_i32x4(r[8 + m], r[12 + m], 0xDD);
+    }
+    for (int m = 0; m < 4; m++) {
+        _mm512_storeu_si512((void*) (dst + m * ldd), _mm512_shuffle_i32x4(t[m], t[8 + m], 0x88));
+        _mm512_storeu_si512((void*) (dst + (4 + m) * ldd), _mm512_shuffle_i32x4(t[4 + m], t[12 + m], 0x88));
+        _mm512_storeu_si512((void*) (dst + (8 + m) * ldd), _mm512_shuffle_i32x4(t[m], t[8 + m], 0xDD));
+        _mm512_storeu_si512((void*) (dst + (12 + m) * ldd), _mm512_shuffle_i32x4(t[4 + m], t[12 + m], 0xDD));
+    }
+}
+
+__attribute__((target("avx512f")))
+static void transpose_avx512(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                             ssize_t rows, ssize_t cols) {
+
+    TRANSPOSE_BLOCK(16, transpose_tile_avx512);
+}
+
+DEFINE_KERNELS(avx512, "avx512f", 64)
+
+#undef VEC
+#undef LOAD
+#undef LOADU
+#undef STORE
+#undef SET1
+#undef ADD
+#undef SUB
+#undef MINU
+#undef MAXU
+#undef COUNTEQ
+#undef MUL
+#undef SRLI
+#undef AND
+
+////////////////////////////////
+///           AVX2           ///
+////////////////////////////////
+
+#define VEC         __m256i
+#define LOAD(p)     _mm256_load_si256((const __m256i*) (p))
+#define LOADU(p)    _mm256_loadu_si256((const __m256i*) (p))
+#define STORE(p, v) _mm256_store_si256((__m256i*) (p), (v))
+#define SET1(x)     _mm256_set1_epi32((int) (x))
+#define ADD(x, y)   _mm256_add_epi32((x), (y))
+#define SUB(x, y)   _mm256_sub_epi32((x), (y))
+#define MINU(x, y)  _mm256_min_epu32((x), (y))
+#define MAXU(x, y)  _mm256_max_epu32((x), (y))
+#define COUNTEQ(c, x, y) _mm256_sub_epi32((c), _mm256_cmpeq_epi32((x), (y)))
+#define MUL(x, y)   _mm256_mullo_epi32((x), (y))
+#define SRLI(x, n)  _mm256_srli_epi32((x), (n))
+#define AND(x, y)   _mm256_and_si256((x), (y))
+
+/**
+ * Transposes one 8 x 8 tile in registers: unpacks transpose each 4 x 4
+ * sub-block, then 128-bit permutes swap the off-diagonal halves
+ */
+__attribute__((target("avx2")))
+static void transpose_tile_avx2(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds) {
+
+    __m256i r[8], t[8];
+
+    for (int i = 0; i < 8; i++) {
+        r[i] = _mm256_loadu_si256((const __m256i*) (src + i * lds));
+    }
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        r[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        r[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        r[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        r[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int m = 0; m < 4; m++) {
+        _mm256_storeu_si256((__m256i*) (dst + m * ldd), _mm256_permute2x128_si256(r[m], r[4 + m], 0x20));
+        _mm256_storeu_si256((__m256i*) (dst + (4 + m) * ldd), _mm256_permute2x128_si256(r[m], r[4 + m], 0x31));
+    }
+}
+
+__attribute__((target("avx2")))
+static void transpose_avx2(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                           ssize_t rows, ssize_t cols) {
+
+    TRANSPOSE_BLOCK(8, transpose_tile_avx2);
+}
+
+DEFINE_KERNELS(avx2, "avx2", 32)
+
+#undef VEC
+#undef LOAD
+#undef LOADU
+#undef STORE
+#undef SET1
+#undef ADD
+#undef SUB
+#undef MINU
+#undef MAXU
+#undef COUNTEQ
+#undef MUL
+#undef SRLI
+#undef AND
+
+////////////////////////////////
+///          SSE4.1          ///
+////////////////////////////////
+
+#define VEC         __m128i
+#define LOAD(p)     _mm_load_si128((const __m128i*) (p))
+#define LOADU(p)    _mm_loadu_si128((const __m128i*) (p))
+#define STORE(p, v) _mm_store_si128((__m128i*) (p), (v))
+#define SET1(x)     _mm_set1_epi32((int) (x))
+#define ADD(x, y)   _mm_add_epi32((x), (y))
+#define SUB(x, y)   _mm_sub_epi32((x), (y))
+#define MINU(x, y)  _mm_min_epu32((x), (y))
+#define MAXU(x, y)  _mm_max_epu32((x), (y))
+#define COUNTEQ(c, x, y) _mm_sub_epi32((c), _mm_cmpeq_epi32((x), (y)))
+#define MUL(x, y)   _mm_mullo_epi32((x), (y))
+#define SRLI(x, n)  _mm_srli_epi32((x), (n))
+#define AND(x, y)   _mm_and_si128((x), (y))
+
+/**
+ * Transposes one 4 x 4 tile in registers
+ */
+__attribute__((target("sse4.1")))
+static void transpose_tile_sse41(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds) {
+
+    const __m128i r0 = _mm_loadu_si128((const __m128i*) (src));
+    const __m128i r1 = _mm_loadu_si128((const __m128i*) (src + lds));
+    const __m128i r2 = _mm_loadu_si128((const __m128i*) (src + 2 * lds));
+    const __m128i r3 = _mm_loadu_si128((const __m128i*) (src + 3 * lds));
+
+    const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    const __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+    const __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+    const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+    _mm_storeu_si128((__m128i*) (dst), _mm_unpacklo_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*) (dst + ldd), _mm_unpackhi_epi64(t0, t2));
+    _mm_storeu_si128((__m128i*) (dst + 2 * ldd), _mm_unpacklo_epi64(t1, t3));
+    _mm_storeu_si128((__m128i*) (dst + 3 * ldd), _mm_unpackhi_epi64(t1, t3));
+}
+
+__attribute__((target("sse4.1")))
+static void transpose_sse41(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                            ssize_t rows, ssize_t cols) {
+
+    TRANSPOSE_BLOCK(4, transpose_tile_sse41);
+}
+
+DEFINE_KERNELS(sse41, "sse4.1", 16)
+
+#undef VEC
+#undef LOAD
+#undef LOADU
+#undef STORE
+#undef SET1
+#undef ADD
+#undef SUB
+#undef MINU
+#undef MAXU
+#undef COUNTEQ
+#undef MUL
+#undef SRLI
+#undef AND
+
+////////////////////////////////
+///          GENERIC         ///
+////////////////////////////////
+
+static void fill_generic(uint32_t* dst, uint32_t value, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        dst[i] = value;
+    }
+}
+
+static void copy_generic(uint32_t* dst, const uint32_t* src, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        dst[i] = src[i];
+    }
+}
+
+static void add_generic(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        dst[i] = a[i] + b[i];
+    }
+}
+
+static void sub_generic(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        dst[i] = a[i] - b[i];
+    }
+}
+
+static void add_scalar_generic(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        dst[i] = src[i] + scalar;
+    }
+}
+
+static void mul_scalar_generic(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count) {
+
+    for (ssize_t i = 0; i < count; i++) {
+        dst[i] = src[i] * scalar;
+    }
+}
+
+static void transpose_generic(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                              ssize_t rows, ssize_t cols) {
+
+    transpose_edge(dst, ldd, src, lds, 0, rows, 0, cols);
+}
+
+static uint32_t sum_generic(const uint32_t* src, ssize_t count) {
+
+    uint32_t total = 0;
+
+    for (ssize_t i = 0; i < count; i++) {
+        total += src[i];
+    }
+
+    return total;
+}
+
+static const struct simd_ops ops_generic = {
+    .name = "generic",
+    .fill = fill_generic,
+    .copy = copy_generic,
+    .add = add_generic,
+    .sub = sub_generic,
+    .add_scalar = add_scalar_generic,
+    .mul_scalar = mul_scalar_generic,
+    .transpose = transpose_generic,
+    .sum = sum_generic,
+    .scan = scan_generic,
+    .sequence = sequence_generic,
+    .random = random_generic
+};
+
+////////////////////////////////
+///         DISPATCH         ///
+////////////////////////////////
+
+/**
+ * Selects the widest kernel set supported by the running CPU
+ */
+void simd_init(void) {
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        g_level = SIMD_AVX512;
+        g_ops = &ops_avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        g_level = SIMD_AVX2;
+        g_ops = &ops_avx2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        g_level = SIMD_SSE41;
+        g_ops = &ops_sse41;
+    } else {
+        g_level = SIMD_GENERIC;
+        g_ops = &ops_generic;
+    }
+}
+
+/**
+ * Returns the instruction set selected by simd_init
+ */
+enum simd_level simd_level(void) {
+
+    return g_level;
+}
+
+/**
+ * Returns the name of the selected instruction set
+ */
+const char* simd_name(void) {
+
+    return g_ops == NULL ? "none" : g_ops->name;
+}
+
+/**
+ * Sets count elements of dst to value
+ */
+void simd_fill(uint32_t* dst, uint32_t value, ssize_t count) {
+
+    g_ops->fill(dst, value, count);
+}
+
+/**
+ * Copies count elements from src to dst
+ */
+void simd_copy(uint32_t* dst, const uint32_t* src, ssize_t count) {
+
+    g_ops->copy(dst, src, count);
+}
+
+/**
+ * Stores the elementwise sum of a and b in dst
+ */
+void simd_add(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count) {
+
+    g_ops->add(dst, a, b, count);
+}
+
+/**
+ * Stores the elementwise difference of a and b in dst
+ */
+void simd_sub(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count) {
+
+    g_ops->sub(dst, a, b, count);
+}
+
+/**
+ * Stores src plus scalar in dst
+ */
+void simd_add_scalar(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count) {
+
+    g_ops->add_scalar(dst, src, scalar, count);
+}
+
+/**
+ * Stores src multiplied by scalar in dst
+ */
+void simd_mul_scalar(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count) {
+
+    g_ops->mul_scalar(dst, src, scalar, count);
+}
+
+/**
+ * Writes the transpose of a rows x cols block of src (row stride lds)
+ * into dst (row stride ldd)
+ */
+void simd_transpose(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                    ssize_t rows, ssize_t cols) {
+
+    g_ops->transpose(dst, ldd, src, lds, rows, cols);
+}
+
+/**
+ * Returns the sum of count elements of src, mod 2^32
+ */
+uint32_t simd_sum(const uint32_t* src, ssize_t count) {
+
+    return g_ops->sum(src, count);
+}
+
+/**
+ * Folds the sum, minimum, maximum and occurrences of value in count
+ * elements of src into scan
+ */
+void simd_scan(const uint32_t* src, ssize_t count, uint32_t value, struct simd_scan* scan) {
+
+    g_ops->scan(src, count, value, scan);
+}
+
+/**
+ * Stores start + i * step in element i of dst
+ */
+void simd_sequence(uint32_t* dst, uint32_t start, uint32_t step, ssize_t count) {
+
+    g_ops->sequence(dst, start, step, count);
+}
+
+/**
+ * Fills dst with the next count outputs of the fast_rand generator from
+ * state, returning the state after the last
+ */
+uint32_t simd_random(uint32_t* dst, uint32_t state, ssize_t count) {
+
+    return g_ops->random(dst, state, count);
+}
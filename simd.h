@@ -0,0 +1,48 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* linear congruential generator behind fast_rand */
+#define SIMD_RAND_MULTIPLIER 214013u
+#define SIMD_RAND_INCREMENT 2531011u
+
+struct simd_scan {
+    uint32_t sum;
+    uint32_t minimum;
+    uint32_t maximum;
+    uint32_t count;
+};
+
+enum simd_level {
+    SIMD_GENERIC,
+    SIMD_SSE41,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+void simd_init(void);
+
+enum simd_level simd_level(void);
+const char* simd_name(void);
+
+/* elementwise kernels, dst may alias src */
+
+void simd_fill(uint32_t* dst, uint32_t value, ssize_t count);
+void simd_copy(uint32_t* dst, const uint32_t* src, ssize_t count);
+void simd_add(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count);
+void simd_sub(uint32_t* dst, const uint32_t* a, const uint32_t* b, ssize_t count);
+void simd_add_scalar(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count);
+void simd_mul_scalar(uint32_t* dst, const uint32_t* src, uint32_t scalar, ssize_t count);
+
+uint32_t simd_sum(const uint32_t* src, ssize_t count);
+void simd_scan(const uint32_t* src, ssize_t count, uint32_t value, struct simd_scan* scan);
+
+void simd_sequence(uint32_t* dst, uint32_t start, uint32_t step, ssize_t count);
+uint32_t simd_random(uint32_t* dst, uint32_t state, ssize_t count);
+
+void simd_transpose(uint32_t* dst, ssize_t ldd, const uint32_t* src, ssize_t lds,
+                    ssize_t rows, ssize_t cols);
+
+#endif
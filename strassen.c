@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "strassen.h"
+#include "buffer.h"
+#include "gemm.h"
+#include "pool.h"
+#include "simd.h"
+
+/*
+ * Strassen-Winograd multiplication (7 products, 15 additions per level).
+ *
+ * Orders that do not halve cleanly down to the classical base case are
+ * peeled: Strassen runs in place on the largest leading core that does,
+ * and gemm fills in the thin border strips. The seven products of the top level run as
+ * parallel tasks, each on its own team of pool threads; below that each
+ * team follows the two-temporary schedule of Boyer, Dumas, Pernet and
+ * Zhou, and splits every base case gemm and every addition across its
+ * members. Arithmetic is exact mod 2^32, so results match gemm().
+ */
+
+#define NTASKS 7
+
+struct team {
+    ssize_t rank;
+    ssize_t size;
+    pthread_barrier_t* barrier;
+};
+
+struct strassen_job {
+    ssize_t n;
+    ssize_t ld;
+    ssize_t depth;
+    ssize_t threads;
+    const uint32_t* a;
+    const uint32_t* b;
+    uint32_t* c;
+    uint32_t* operands[NTASKS][2];
+    uint32_t* products[NTASKS];
+    uint32_t* work[NTASKS];
+    pthread_barrier_t barriers[NTASKS];
+};
+
+////////////////////////////////
+///      TEAM PRIMITIVES     ///
+////////////////////////////////
+
+static void team_sync(const struct team* team) {
+
+    if (team->size > 1) {
+        pthread_barrier_wait(team->barrier);
+    }
+}
+
+/**
+ * dst = a + b over an n x n block, rows split across the team
+ */
+static void team_add(const struct team* team, ssize_t n, uint32_t* dst, ssize_t ldd,
+                     const uint32_t* a, ssize_t lda, const uint32_t* b, ssize_t ldb) {
+
+    const ssize_t end = (team->rank + 1) * n / team->size;
+
+    for (ssize_t i = team->rank * n / team->size; i < end; i++) {
+        simd_add(dst + i * ldd, a + i * lda, b + i * ldb, n);
+    }
+}
+
+/**
+ * dst = a - b over an n x n block, rows split across the team
+ */
+static void team_sub(const struct team* team, ssize_t n, uint32_t* dst, ssize_t ldd,
+                     const uint32_t* a, ssize_t lda, const uint32_t* b, ssize_t ldb) {
+
+    const ssize_t end = (team->rank + 1) * n / team->size;
+
+    for (ssize_t i = team->rank * n / team->size; i < end; i++) {
+        simd_sub(dst + i * ldd, a + i * lda, b + i * ldb, n);
+    }
+}
+
+/**
+ * Returns the scratch elements team_mul needs for an n x n product
+ */
+static ssize_t work_size(ssize_t n, ssize_t depth) {
+
+    ssize_t total = 0;
+
+    for (; depth > 0; depth--) {
+        n /= 2;
+        total += 2 * n * n;
+    }
+
+    return total;
+}
+
+/**
+ * C = A * B for n x n blocks on a team, recursing depth more levels.
+ * Every member must call it; C is complete for all members on return.
+ */
+static void team_mul(const struct team* team, ssize_t n,
+                     const uint32_t* a, ssize_t lda,
+                     const uint32_t* b, ssize_t ldb,
+                     uint32_t* c, ssize_t ldc,
+                     uint32_t* work, ssize_t depth) {
+
+    if (depth == 0) {
+        gemm_part(n, n, n, a, lda, b, ldb, c, ldc, team->rank, team->size);
+        team_sync(team);
+        return;
+    }
+
+    const ssize_t h = n / 2;
+
+    const uint32_t* a11 = a;
+    const uint32_t* a12 = a + h;
+    const uint32_t* a21 = a + h * lda;
+    const uint32_t* a22 = a + h * lda + h;
+    const uint32_t* b11 = b;
+    const uint32_t* b12 = b + h;
+    const uint32_t* b21 = b + h * ldb;
+    const uint32_t* b22 = b + h * ldb + h;
+    uint32_t* c11 = c;
+    uint32_t* c12 = c + h;
+    uint32_t* c21 = c + h * ldc;
+    uint32_t* c22 = c + h * ldc + h;
+
+    uint32_t* x = work;
+    uint32_t* y = work + h * h;
+    uint32_t* next = work + 2 * h * h;
+
+    team_sub(team, h, x, h, a11, lda, a21, lda);            /* S3 */
+    team_sub(team, h, y, h, b22, ldb, b12, ldb);            /* T3 */
+    team_sync(team);
+    team_mul(team, h, x, h, y, h, c21, ldc, next, depth - 1);   /* P7 */
+
+    team_add(team, h, x, h, a21, lda, a22, lda);            /* S1 */
+    team_sub(team, h, y, h, b12, ldb, b11, ldb);            /* T1 */
+    team_sync(team);
+    team_mul(team, h, x, h, y, h, c22, ldc, next, depth - 1);   /* P5 */
+
+    team_sub(team, h, x, h, x, h, a11, lda);                /* S2 */
+    team_sub(team, h, y, h, b22, ldb, y, h);                /* T2 */
+    team_sync(team);
+    team_mul(team, h, x, h, y, h, c12, ldc, next, depth - 1);   /* P6 */
+
+    team_sub(team, h, x, h, a12, lda, x, h);                /* S4 */
+    team_sync(team);
+    team_mul(team, h, x, h, b22, ldb, c11, ldc, next, depth - 1);   /* P3 */
+    team_mul(team, h, a11, lda, b11, ldb, x, h, next, depth - 1);   /* P1 */
+
+    team_add(team, h, c12, ldc, x, h, c12, ldc);            /* U2 = P1 + P6 */
+    team_add(team, h, c21, ldc, c12, ldc, c21, ldc);        /* U3 = U2 + P7 */
+    team_add(team, h, c12, ldc, c12, ldc, c22, ldc);        /* U4 = U2 + P5 */
+    team_add(team, h, c22, ldc, c21, ldc, c22, ldc);        /* U7 = U3 + P5 */
+    team_add(team, h, c12, ldc, c12, ldc, c11, ldc);        /* U5 = U4 + P3 */
+    team_sub(team, h, y, h, y, h, b21, ldb);                /* T4 */
+    team_sync(team);
+    team_mul(team, h, a22, lda, y, h, c11, ldc, next, depth - 1);   /* P4 */
+
+    team_sub(team, h, c21, ldc, c21, ldc, c11, ldc);        /* U6 = U3 - P4 */
+    team_sync(team);
+    team_mul(team, h, a12, lda, b21, ldb, c11, ldc, next, depth - 1);   /* P2 */
+
+    team_add(team, h, c11, ldc, x, h, c11, ldc);            /* U1 = P1 + P2 */
+    team_sync(team);
+}
+
+////////////////////////////////
+///       TOP LEVEL TASKS    ///
+////////////////////////////////
+
+/**
+ * Forms the operands of top level product `task` and multiplies them
+ */
+static void run_task(struct strassen_job* job, ssize_t task, const struct team* team) {
+
+    const ssize_t n = job->ld;
+    const ssize_t h = job->n / 2;
+
+    const uint32_t* a11 = job->a;
+    const uint32_t* a12 = job->a + h;
+    const uint32_t* a21 = job->a + h * n;
+    const uint32_t* a22 = job->a + h * n + h;
+    const uint32_t* b11 = job->b;
+    const uint32_t* b12 = job->b + h;
+    const uint32_t* b21 = job->b + h * n;
+    const uint32_t* b22 = job->b + h * n + h;
+
+    uint32_t* x = job->operands[task][0];
+    uint32_t* y = job->operands[task][1];
+    uint32_t* p = job->products[task];
+    uint32_t* work = job->work[task];
+    const ssize_t depth = job->depth - 1;
+
+    switch (task) {
+        case 0:                                                 /* P1 = A11 B11 */
+            team_mul(team, h, a11, n, b11, n, p, n, work, depth);
+            break;
+
+        case 1:                                                 /* P2 = A12 B21 */
+            team_mul(team, h, a12, n, b21, n, p, n, work, depth);
+            break;
+
+        case 2:                                                 /* P3 = S4 B22 */
+            team_add(team, h, x, h, a21, n, a22, n);
+            team_sub(team, h, x, h, x, h, a11, n);
+            team_sub(team, h, x, h, a12, n, x, h);
+            team_sync(team);
+            team_mul(team, h, x, h, b22, n, p, n, work, depth);
+            break;
+
+        case 3:                                                 /* P4 = A22 T4 */
+            team_sub(team, h, y, h, b12, n, b11, n);
+            team_sub(team, h, y, h, b22, n, y, h);
+            team_sub(team, h, y, h, y, h, b21, n);
+            team_sync(team);
+            team_mul(team, h, a22, n, y, h, p, n, work, depth);
+            break;
+
+        case 4:                                                 /* P5 = S1 T1 */
+            team_add(team, h, x, h, a21, n, a22, n);
+            team_sub(team, h, y, h, b12, n, b11, n);
+            team_sync(team);
+            team_mul(team, h, x, h, y, h, p, h, work, depth);
+            break;
+
+        case 5:                                                 /* P6 = S2 T2 */
+            team_add(team, h, x, h, a21, n, a22, n);
+            team_sub(team, h, x, h, x, h, a11, n);
+            team_sub(team, h, y, h, b12, n, b11, n);
+            team_sub(team, h, y, h, b22, n, y, h);
+            team_sync(team);
+            team_mul(team, h, x, h, y, h, p, h, work, depth);
+            break;
+
+        case 6:                                                 /* P7 = S3 T3 */
+            team_sub(team, h, x, h, a11, n, a21, n);
+            team_sub(team, h, y, h, b22, n, b12, n);
+            team_sync(team);
+            team_mul(team, h, x, h, y, h, p, h, work, depth);
+            break;
+    }
+}
+
+/**
+ * Assigns each thread to a task team, or a run of tasks when there are
+ * fewer threads than tasks
+ */
+static void strassen_task(void* arg, ssize_t tid) {
+
+    struct strassen_job* job = (struct strassen_job*) arg;
+    const ssize_t threads = job->threads;
+
+    if (threads >= NTASKS) {
+        const ssize_t task = tid * NTASKS / threads;
+        const ssize_t first = (task * threads + NTASKS - 1) / NTASKS;
+        const ssize_t next = ((task + 1) * threads + NTASKS - 1) / NTASKS;
+
+        const struct team team = {
+            .rank = tid - first,
+            .size = next - first,
+            .barrier = job->barriers + task
+        };
+
+        run_task(job, task, &team);
+        return;
+    }
+
+    const struct team solo = {
+        .rank = 0,
+        .size = 1,
+        .barrier = NULL
+    };
+
+    for (ssize_t task = tid * NTASKS / threads; task < (tid + 1) * NTASKS / threads; task++) {
+        run_task(job, task, &solo);
+    }
+}
+
+/**
+ * Combines the seven products into the quadrants of C, where P1..P4
+ * were written straight into C11, C12, C21 and C22
+ */
+static void combine_worker(void* arg, ssize_t start, ssize_t end) {
+
+    struct strassen_job* job = (struct strassen_job*) arg;
+    const ssize_t n = job->ld;
+    const ssize_t h = job->n / 2;
+
+    for (ssize_t i = start; i < end; i++) {
+        uint32_t* c11 = job->c + i * n;
+        uint32_t* c12 = c11 + h;
+        uint32_t* c21 = c11 + h * n;
+        uint32_t* c22 = c21 + h;
+        uint32_t* p5 = job->products[4] + i * h;
+        uint32_t* p6 = job->products[5] + i * h;
+        uint32_t* p7 = job->products[6] + i * h;
+
+        simd_add(p6, c11, p6, h);       /* U2 = P1 + P6 */
+        simd_add(c11, c11, c12, h);     /* U1 = P1 + P2 */
+        simd_add(p7, p6, p7, h);        /* U3 = U2 + P7 */
+        simd_add(p6, p6, p5, h);        /* U4 = U2 + P5 */
+        simd_add(c12, p6, c21, h);      /* U5 = U4 + P3 */
+        simd_sub(c21, p7, c22, h);      /* U6 = U3 - P4 */
+        simd_add(c22, p7, p5, h);       /* U7 = U3 + P5 */
+    }
+}
+
+/**
+ * Runs one level of Strassen-Winograd on n x n blocks, n even, of
+ * matrices with leading dimension ld, with the seven products in
+ * parallel and depth - 1 levels below them
+ */
+static void strassen_level(ssize_t n, ssize_t ld, ssize_t depth,
+                           const uint32_t* a, const uint32_t* b, uint32_t* c) {
+
+    const ssize_t h = n / 2;
+    const ssize_t quarter = h * h;
+    const ssize_t work = work_size(h, depth - 1);
+
+    struct strassen_job job = {
+        .n = n,
+        .ld = ld,
+        .depth = depth,
+        .threads = pool_concurrency(),
+        .a = a,
+        .b = b,
+        .c = c
+    };
+
+    /* S4, T4, S1 T1, S2 T2, S3 T3, then P5..P7 and the task scratch */
+    const size_t bytes = (11 * quarter + NTASKS * work) * sizeof(uint32_t);
+    uint32_t* block = buffer_alloc(bytes);
+
+    uint32_t* next = block;
+    job.operands[2][0] = next; next += quarter;
+    job.operands[3][1] = next; next += quarter;
+    for (ssize_t task = 4; task < NTASKS; task++) {
+        job.operands[task][0] = next; next += quarter;
+        job.operands[task][1] = next; next += quarter;
+    }
+    for (ssize_t task = 4; task < NTASKS; task++) {
+        job.products[task] = next; next += quarter;
+    }
+    for (ssize_t task = 0; task < NTASKS; task++) {
+        job.work[task] = next; next += work;
+    }
+
+    job.products[0] = c;
+    job.products[1] = c + h;
+    job.products[2] = c + h * ld;
+    job.products[3] = c + h * ld + h;
+
+    if (job.threads >= NTASKS) {
+        for (ssize_t task = 0; task < NTASKS; task++) {
+            const ssize_t first = (task * job.threads + NTASKS - 1) / NTASKS;
+            const ssize_t last = ((task + 1) * job.threads + NTASKS - 1) / NTASKS;
+            pthread_barrier_init(job.barriers + task, NULL, last - first);
+        }
+    }
+
+    if (job.threads > 1) {
+        pool_run(strassen_task, &job);
+    } else {
+        strassen_task(&job, 0);
+    }
+
+    pool_steal(combine_worker, &job, h, 8);
+
+    if (job.threads >= NTASKS) {
+        for (ssize_t task = 0; task < NTASKS; task++) {
+            pthread_barrier_destroy(job.barriers + task);
+        }
+    }
+
+    buffer_free(block);
+}
+
+/**
+ * Computes C = A * B for n x n matrices, recursing while the blocks are
+ * at least threshold wide
+ */
+void strassen(ssize_t n, const uint32_t* a, const uint32_t* b, uint32_t* c, ssize_t threshold) {
+
+    ssize_t depth = 0;
+    ssize_t base = n;
+
+    while (threshold > 0 && base >= threshold && base > 1) {
+        base = (base + 1) / 2;
+        depth++;
+    }
+
+    /* tiny thresholds can recurse past the order itself */
+    while (depth > 0 && (n >> depth) == 0) {
+        depth--;
+    }
+
+    if (depth == 0) {
+        gemm(n, n, n, a, n, b, n, c, n);
+        return;
+    }
+
+    /* the leading m x m core halves cleanly, leaving r < 2^depth rows and columns */
+    const ssize_t m = (n >> depth) << depth;
+    const ssize_t r = n - m;
+
+    strassen_level(m, n, depth, a, b, c);
+
+    if (r == 0) {
+        return;
+    }
+
+    gemm_add(m, m, r, a + m, n, b + m * n, n, c, n);        /* C11 += A12 B21 */
+    gemm(m, r, n, a, n, b + m, n, c + m, n);                /* C12 = A1* B*2 */
+    gemm(r, n, n, a + m * n, n, b, n, c + m * n, n);        /* C2* = A2* B */
+}
@@ -0,0 +1,9 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+void strassen(ssize_t n, const uint32_t* a, const uint32_t* b, uint32_t* c, ssize_t threshold);
+
+#endif